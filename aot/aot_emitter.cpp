@@ -0,0 +1,366 @@
+#include "aot_emitter.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+#include "../runtime/aot_abi.h"
+#include "../runtime/translate_common.h"
+
+namespace vm32 {
+
+namespace {
+
+std::string fmt(const char* f, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, f);
+    std::vsnprintf(buf, sizeof buf, f, args);
+    va_end(args);
+    return buf;
+}
+
+class Emitter {
+public:
+    Emitter(const std::vector<DecodedInsn>& insns, const std::vector<bool>& isLabel, std::string& out)
+        : m_insns(insns), m_isLabel(isLabel), m_out(out) {}
+
+    // Emits the block of instructions [first, last); `exit` is the address of an
+    // interpreter-only instruction that ends it, or ~0u.
+    void block(std::size_t first, std::size_t last, u32 exit);
+
+private:
+    struct Stack {
+        std::vector<std::string> locals; // values above the memory stack, bottom first
+        int base{0};                     // memory stack cells consumed (<= 0)
+    };
+
+    std::string temp(const std::string& expr) {
+        const std::string name = "t" + std::to_string(m_temps++);
+        line("const int32_t " + name + " = " + expr + ";");
+        return name;
+    }
+    static std::string cell(int off) {
+        if (off == 0) return "mem[sp]";
+        return off > 0 ? fmt("mem[sp + %d]", off) : fmt("mem[sp - %d]", -off);
+    }
+    std::string pop() {
+        if (!m_stack.locals.empty()) {
+            std::string v = m_stack.locals.back();
+            m_stack.locals.pop_back();
+            return v;
+        }
+        return temp(cell(--m_stack.base));
+    }
+    void push(const std::string& expr) { m_stack.locals.push_back(temp(expr)); }
+    void line(const std::string& s) {
+        if (!s.empty()) m_out += "        " + s + "\n";
+    }
+
+    std::string spill(const Stack& st) const {
+        std::string s;
+        for (std::size_t i = 0; i < st.locals.size(); ++i) {
+            s += cell(st.base + static_cast<int>(i)) + " = " + st.locals[i] + "; ";
+        }
+        const int delta = st.base + static_cast<int>(st.locals.size());
+        if (delta != 0) s += delta > 0 ? fmt("sp += %d; ", delta) : fmt("sp -= %d; ", -delta);
+        return s;
+    }
+    // Leave before `in`, with the stack as it was before it.
+    std::string fallback(const DecodedInsn& in) const {
+        return "{ " + spill(m_before) + fmt("ip = %u; steps -= %u; goto out_fallback; }", in.addr, m_remaining);
+    }
+    std::string jumpTo(u32 target) const {
+        if (target < m_isLabel.size() && m_isLabel[target]) return fmt("goto L_%u;", target);
+        return fmt("{ ip = %u; goto dispatch; }", target);
+    }
+
+    void insn(const DecodedInsn& in, bool last);
+
+    const std::vector<DecodedInsn>& m_insns;
+    const std::vector<bool>& m_isLabel;
+    std::string& m_out;
+    Stack m_stack;
+    Stack m_before;
+    u32 m_remaining{0}; // instructions of the block not yet executed, including the current one
+    u32 m_temps{0};
+};
+
+void Emitter::block(std::size_t first, std::size_t last, u32 exit) {
+    const u32 start = first < last ? m_insns[first].addr : exit;
+    const u32 count = static_cast<u32>(last - first);
+    m_out += fmt("L_%u:\n", start);
+    if (count > 0) {
+        int lowest, highest;
+        stackBounds(m_insns, first, last, lowest, highest);
+        m_out += fmt("    if (budget - steps < %u) { ip = %u; goto out_budget; }\n", count, start);
+        std::string check;
+        if (lowest < 0) check += fmt("sp - lo < %d", -lowest);
+        if (highest > 0) check += (check.empty() ? "" : " || ") + fmt("hi - sp < %d", highest);
+        if (!check.empty()) m_out += "    if (" + check + fmt(") { ip = %u; goto out_fallback; }\n", start);
+        m_out += fmt("    steps += %u;\n", count);
+    }
+    m_out += "    {\n";
+    m_stack = Stack{};
+    for (std::size_t i = first; i < last; ++i) {
+        m_remaining = static_cast<u32>(last - i);
+        insn(m_insns[i], i + 1 == last && exit == ~0u);
+    }
+    if (exit != ~0u) {
+        line(spill(m_stack) + fmt("ip = %u; goto out_fallback;", exit));
+    }
+    m_out += "    }\n";
+}
+
+void Emitter::insn(const DecodedInsn& in, bool last) {
+    m_before = m_stack;
+    const std::string fb = fallback(in);
+    std::string a, b, c;
+    switch (in.op) {
+        case Op::PUSHI: push(fmt("(int32_t)0x%08xu", in.a)); break;
+        case Op::POP: pop(); break;
+        case Op::DUP: a = pop(); m_stack.locals.push_back(a); m_stack.locals.push_back(a); break;
+        case Op::SWAP: b = pop(); a = pop(); m_stack.locals.push_back(b); m_stack.locals.push_back(a); break;
+        case Op::OVER:
+            b = pop(); a = pop();
+            m_stack.locals.push_back(a); m_stack.locals.push_back(b); m_stack.locals.push_back(a);
+            break;
+        case Op::NEG: a = pop(); push("(int32_t)(0u - (uint32_t)" + a + ")"); break;
+        case Op::NOT: a = pop(); push("~" + a); break;
+        case Op::FNEG: a = pop(); push(a + " ^ (int32_t)0x80000000u"); break;
+        case Op::FSQRT: a = pop(); push("f32ToCell(std::sqrt(cellToF32(" + a + ")))"); break;
+        case Op::ITOF: a = pop(); push("f32ToCell((float)" + a + ")"); break;
+        case Op::FTOI: a = pop(); push("ftoi(" + a + ")"); break;
+
+        case Op::ADD: b = pop(); a = pop(); push("(int32_t)((uint32_t)" + a + " + (uint32_t)" + b + ")"); break;
+        case Op::SUB: b = pop(); a = pop(); push("(int32_t)((uint32_t)" + a + " - (uint32_t)" + b + ")"); break;
+        case Op::MUL: b = pop(); a = pop(); push("(int32_t)((uint32_t)" + a + " * (uint32_t)" + b + ")"); break;
+        case Op::DIV:
+        case Op::MOD:
+            b = pop(); a = pop();
+            line("if (" + b + " == 0 || (" + a + " == INT32_MIN && " + b + " == -1)) " + fb);
+            push(a + (in.op == Op::DIV ? " / " : " % ") + b);
+            break;
+        case Op::DIVU:
+        case Op::MODU:
+            b = pop(); a = pop();
+            line("if (" + b + " == 0) " + fb);
+            push("(int32_t)((uint32_t)" + a + (in.op == Op::DIVU ? " / " : " % ") + "(uint32_t)" + b + ")");
+            break;
+        case Op::AND: b = pop(); a = pop(); push(a + " & " + b); break;
+        case Op::OR:  b = pop(); a = pop(); push(a + " | " + b); break;
+        case Op::XOR: b = pop(); a = pop(); push(a + " ^ " + b); break;
+        case Op::SHL: b = pop(); a = pop(); push("(int32_t)((uint32_t)" + a + " << ((uint32_t)" + b + " & 31u))"); break;
+        case Op::SHR: b = pop(); a = pop(); push("(int32_t)((uint32_t)" + a + " >> ((uint32_t)" + b + " & 31u))"); break;
+        case Op::SAR: b = pop(); a = pop(); push(a + " >> ((uint32_t)" + b + " & 31u)"); break;
+        case Op::CMP_EQ: b = pop(); a = pop(); push("(int32_t)(" + a + " == " + b + ")"); break;
+        case Op::CMP_LT: b = pop(); a = pop(); push("(int32_t)(" + a + " < " + b + ")"); break;
+        case Op::CMP_GT: b = pop(); a = pop(); push("(int32_t)(" + a + " > " + b + ")"); break;
+        case Op::CMP_LTU: b = pop(); a = pop(); push("(int32_t)((uint32_t)" + a + " < (uint32_t)" + b + ")"); break;
+
+        case Op::LERP8X4:
+            c = pop(); b = pop(); a = pop();
+            push("(int32_t)lanes::lerp8x4((uint32_t)" + a + ", (uint32_t)" + b + ", (uint32_t)(" + c + " < 0 ? 0 : " + c +
+                 " > 256 ? 256 : " + c + "))");
+            break;
+        case Op::VADD8: case Op::VADDS8: case Op::VSUBS8: case Op::VMUL8:
+        case Op::VMIN8: case Op::VMAX8: case Op::VAVG8:
+        case Op::VADD16: case Op::VADDS16: case Op::VSUBS16: case Op::VMUL16:
+        case Op::VMIN16: case Op::VMAX16: case Op::VAVG16: {
+            const char* fn = "";
+            switch (in.op) {
+                case Op::VADD8: fn = "add<8>"; break;
+                case Op::VADDS8: fn = "addSat<8>"; break;
+                case Op::VSUBS8: fn = "subSat<8>"; break;
+                case Op::VMUL8: fn = "mul8"; break;
+                case Op::VMIN8: fn = "min<8>"; break;
+                case Op::VMAX8: fn = "max<8>"; break;
+                case Op::VAVG8: fn = "avg<8>"; break;
+                case Op::VADD16: fn = "add<16>"; break;
+                case Op::VADDS16: fn = "addSat<16>"; break;
+                case Op::VSUBS16: fn = "subSat<16>"; break;
+                case Op::VMUL16: fn = "mul16"; break;
+                case Op::VMIN16: fn = "min<16>"; break;
+                case Op::VMAX16: fn = "max<16>"; break;
+                default: fn = "avg<16>"; break;
+            }
+            b = pop(); a = pop();
+            push(std::string("(int32_t)lanes::") + fn + "((uint32_t)" + a + ", (uint32_t)" + b + ")");
+            break;
+        }
+        case Op::FADD: b = pop(); a = pop(); push("f32ToCell(cellToF32(" + a + ") + cellToF32(" + b + "))"); break;
+        case Op::FSUB: b = pop(); a = pop(); push("f32ToCell(cellToF32(" + a + ") - cellToF32(" + b + "))"); break;
+        case Op::FMUL: b = pop(); a = pop(); push("f32ToCell(cellToF32(" + a + ") * cellToF32(" + b + "))"); break;
+        case Op::FDIV: b = pop(); a = pop(); push("f32ToCell(cellToF32(" + a + ") / cellToF32(" + b + "))"); break;
+        case Op::FCMP: b = pop(); a = pop(); push("fcmp(" + a + ", " + b + ")"); break;
+        case Op::FXMUL: b = pop(); a = pop(); push("(int32_t)(uint32_t)(((int64_t)" + a + " * " + b + ") >> 16)"); break;
+        case Op::FXDIV:
+            b = pop(); a = pop();
+            line("if (" + b + " == 0) " + fb);
+            push("(int32_t)(uint32_t)(((int64_t)" + a + " * 65536) / " + b + ")");
+            break;
+
+        case Op::LOAD: push(fmt("mem[%u]", in.a)); break;
+        case Op::STORE: a = pop(); line(fmt("mem[%u] = ", in.a) + a + ";"); break;
+        case Op::LOAD_IND:
+        case Op::LOAD_IDX:
+            a = pop();
+            c = temp(in.op == Op::LOAD_IDX ? fmt("(int32_t)(%uu + (uint32_t)", in.a) + a + ")" : a);
+            line(fmt("if ((uint32_t)%s >= %uu || (uint32_t)%s == %uu) ", c.c_str(), VM::MEM_SIZE, c.c_str(), VM::CORE_ID_ADDR) + fb);
+            push("mem[(uint32_t)" + c + "]");
+            break;
+        case Op::STORE_IND:
+        case Op::STORE_IDX:
+            c = pop(); b = pop();
+            if (in.op == Op::STORE_IDX) c = temp(fmt("(int32_t)(%uu + (uint32_t)", in.a) + c + ")");
+            line(fmt("if ((uint32_t)%s >= %uu || (uint32_t)%s == %uu || (uint32_t)%s == %uu || (uint32_t)%s == %uu) ",
+                     c.c_str(), VM::MEM_SIZE, c.c_str(), VM::BARRIER_ADDR, c.c_str(), VM::IRQ_ENABLE_ADDR,
+                     c.c_str(), VM::DMA_CTRL_ADDR) + fb);
+            line("mem[(uint32_t)" + c + "] = " + b + ";");
+            break;
+        case Op::FB_XY:
+            b = pop(); a = pop();
+            line(fmt("if ((uint32_t)%s >= %uu || (uint32_t)%s >= %uu) ", a.c_str(), VM::FB_WIDTH, b.c_str(), VM::FB_HEIGHT) + fb);
+            push(fmt("(int32_t)(%uu + (uint32_t)", VM::FB_BASE) + b + fmt(" * %uu + (uint32_t)", VM::FB_WIDTH) + a + ")");
+            break;
+
+        case Op::JMP:
+            line(spill(m_stack) + jumpTo(in.a));
+            m_stack = Stack{};
+            return;
+        case Op::JZ: case Op::JNZ:
+        case Op::JEQ: case Op::JNE: case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+        case Op::JEQ_IMM: case Op::JNE_IMM: case Op::JLT_IMM: case Op::JLE_IMM: case Op::JGT_IMM: case Op::JGE_IMM: {
+            const bool imm = in.op >= Op::JEQ_IMM && in.op <= Op::JGE_IMM;
+            const u32 target = imm ? in.b : in.a;
+            std::string cond;
+            if (in.op == Op::JZ || in.op == Op::JNZ) {
+                a = pop();
+                cond = a + (in.op == Op::JZ ? " == 0" : " != 0");
+            } else {
+                if (imm) {
+                    b = fmt("(int32_t)0x%08xu", in.a);
+                } else {
+                    b = pop();
+                }
+                a = pop();
+                const char* rel = "==";
+                switch (in.op) {
+                    case Op::JNE: case Op::JNE_IMM: rel = "!="; break;
+                    case Op::JLT: case Op::JLT_IMM: rel = "<"; break;
+                    case Op::JLE: case Op::JLE_IMM: rel = "<="; break;
+                    case Op::JGT: case Op::JGT_IMM: rel = ">"; break;
+                    case Op::JGE: case Op::JGE_IMM: rel = ">="; break;
+                    default: break;
+                }
+                cond = a + " " + rel + " " + b;
+            }
+            c = temp("(int32_t)(" + cond + ")");
+            if (target >= VM::MEM_SIZE) {
+                line("if (" + c + ") " + fb);
+                line(spill(m_stack) + jumpTo(in.next));
+            } else {
+                line(spill(m_stack));
+                line("if (" + c + ") " + jumpTo(target));
+                line(jumpTo(in.next));
+            }
+            m_stack = Stack{};
+            return;
+        }
+        default:
+            break;
+    }
+    if (last) line(spill(m_stack) + jumpTo(in.next));
+}
+
+const char* kPrelude = R"(// Generated by aot from an LJBC program; do not edit.
+#include <cmath>
+#include <cstdint>
+
+#include "aot_abi.h"
+#include "packed_lanes.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wunused-label"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#endif
+
+namespace {
+
+using namespace vm32;
+
+inline int32_t ftoi(int32_t cell) {
+    const float f = cellToF32(cell);
+    if (std::isnan(f)) return 0;
+    if (f >= 2147483648.0f) return 0x7FFFFFFF;
+    if (f <= -2147483648.0f) return (int32_t)0x80000000u;
+    return (int32_t)f;
+}
+
+inline int32_t fcmp(int32_t a, int32_t b) {
+    const float fa = cellToF32(a), fb = cellToF32(b);
+    return (fa < fb) ? -1 : (fa > fb) ? 1 : (fa == fb) ? 0 : 2;
+}
+
+)";
+
+} // namespace
+
+bool translateToNative(const std::vector<u32>& cells, std::string& outSource, std::string* outError) {
+    std::vector<DecodedInsn> insns;
+    std::vector<TranslationPiece> pieces;
+    const std::size_t codeEnd = decodePieces(cells.data(), cells.size(), insns, pieces);
+    if (pieces.empty()) {
+        if (outError) *outError = "No code to translate";
+        return false;
+    }
+
+    // Every piece starts at a label; those with native code are also entry points.
+    std::vector<bool> isLabel(codeEnd, false);
+    std::vector<u32> entries;
+    for (const TranslationPiece& p : pieces) {
+        const u32 start = p.first < p.last ? insns[p.first].addr : p.exit;
+        isLabel[start] = true;
+        if (p.first < p.last) entries.push_back(start);
+    }
+
+    std::string body;
+    Emitter emitter(insns, isLabel, body);
+    for (const TranslationPiece& p : pieces) emitter.block(p.first, p.last, p.exit);
+
+    std::string& out = outSource;
+    out = kPrelude;
+    out += "const uint32_t kEntries[] = {";
+    for (std::size_t i = 0; i < entries.size(); ++i) out += (i % 12 ? " " : "\n    ") + std::to_string(entries[i]) + ",";
+    if (entries.empty()) out += " 0";
+    out += "\n};\n\n";
+    out += "int run(LjAotState* s) {\n"
+           "    int32_t* const mem = s->mem;\n"
+           "    const uint32_t lo = s->stackLo;\n"
+           "    const uint32_t hi = s->stackHi;\n"
+           "    const uint64_t budget = s->budget;\n"
+           "    uint32_t sp = s->sp;\n"
+           "    uint32_t ip = s->ip;\n"
+           "    uint64_t steps = 0;\n"
+           "    (void)lo; (void)hi;\n"
+           "dispatch:\n"
+           "    switch (ip) {\n";
+    for (u32 e : entries) out += fmt("        case %u: goto L_%u;\n", e, e);
+    out += "        default: goto out_fallback;\n"
+           "    }\n";
+    out += body;
+    out += "out_budget:\n"
+           "    s->ip = ip; s->sp = sp; s->steps = steps;\n"
+           "    return LJ_AOT_BUDGET;\n"
+           "out_fallback:\n"
+           "    s->ip = ip; s->sp = sp; s->steps = steps;\n"
+           "    return LJ_AOT_FALLBACK;\n"
+           "}\n\n";
+    out += fmt("const LjAotProgram kProgram = { LJ_AOT_ABI_VERSION, %zuu, 0x%016llxull, kEntries, %zuu, run };\n\n",
+               cells.size(), static_cast<unsigned long long>(lj_aot_hash(cells.data(), cells.size())), entries.size());
+    out += "} // namespace\n\n"
+           "extern \"C\" LJ_AOT_EXPORT const LjAotProgram* lj_aot_program(void) { return &kProgram; }\n";
+    return true;
+}
+
+} // namespace vm32
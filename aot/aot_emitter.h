@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// Translates a program (cells as passed to VM::load()) into C++ source for a
+// native module implementing runtime/aot_abi.h. Code is split at basic block
+// boundaries and after every instruction left to the interpreter; each piece
+// becomes a labelled block in one function, with jumps between them as gotos.
+// Within a block, stack values live in locals and only reach memory when the
+// block exits. The source needs runtime/ on the include path.
+bool translateToNative(const std::vector<u32>& cells, std::string& outSource, std::string* outError = nullptr);
+
+} // namespace vm32
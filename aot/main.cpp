@@ -0,0 +1,38 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "aot_emitter.h"
+#include "../bytecode/bytecode_io.h"
+
+// Translates an LJBC program into C++ for a native module. Build the output as
+// a shared object and pass it to the runtime with --native, e.g.
+//   aot program.ljbc program_aot.cpp
+//   c++ -O2 -shared -fPIC -I runtime program_aot.cpp -o program_aot.so
+//   runtime program.ljbc --native ./program_aot.so
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::printf("usage: aot program.ljbc out.cpp\n");
+        return 1;
+    }
+    std::vector<vm32::u32> cells;
+    std::string err;
+    if (!vm32::loadBytecodeFromFile(argv[1], cells, &err)) {
+        std::printf("Failed to load %s: %s\n", argv[1], err.c_str());
+        return 1;
+    }
+    std::string source;
+    if (!vm32::translateToNative(cells, source, &err)) {
+        std::printf("Failed to translate %s: %s\n", argv[1], err.c_str());
+        return 1;
+    }
+    std::ofstream out(argv[2], std::ios::binary);
+    if (!out || !out.write(source.data(), static_cast<std::streamsize>(source.size()))) {
+        std::printf("Failed to write %s\n", argv[2]);
+        return 1;
+    }
+    std::printf("Wrote %s (%zu cells)\n", argv[2], cells.size());
+    std::printf("Build with: c++ -O2 -shared -fPIC -I runtime %s -o module.so\n", argv[2]);
+    return 0;
+}
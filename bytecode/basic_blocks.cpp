@@ -0,0 +1,39 @@
+#include "basic_blocks.h"
+
+#include "opcode_info.h"
+
+namespace vm32 {
+
+std::vector<BasicBlock> findBasicBlocks(const u32* code, std::size_t count, std::size_t* outCodeEnd) {
+    // Decode instruction starts; mark leaders as we go.
+    std::vector<u32> starts;
+    std::vector<bool> isStart(count + 1, false), isLeader(count + 1, false);
+    std::size_t pc = 0;
+    while (pc < count) {
+        OpInfo info;
+        if (!opInfo(code[pc], info) || pc + info.operands >= count) break;
+        starts.push_back(static_cast<u32>(pc));
+        isStart[pc] = true;
+        const std::size_t next = pc + 1 + info.operands;
+        if (info.flags & (OPF_BRANCH | OPF_CODE)) {
+            const u32 target = code[pc + info.operands];
+            if (target < count) isLeader[target] = true;
+        }
+        if (info.flags & (OPF_BRANCH | OPF_STOP | OPF_SWITCH)) isLeader[next] = true;
+        pc = next;
+    }
+    if (outCodeEnd) *outCodeEnd = pc;
+    if (!starts.empty()) isLeader[0] = true;
+
+    std::vector<BasicBlock> blocks;
+    for (std::size_t i = 0; i < starts.size(); ++i) {
+        const u32 at = starts[i];
+        if (isLeader[at] && isStart[at]) blocks.push_back({ at, at, at });
+        BasicBlock& b = blocks.back();
+        b.last = at;
+        b.end = (i + 1 < starts.size()) ? starts[i + 1] : static_cast<u32>(pc);
+    }
+    return blocks;
+}
+
+} // namespace vm32
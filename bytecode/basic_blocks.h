@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "opcodes.h"
+
+namespace vm32 {
+
+struct BasicBlock {
+    u32 start{0}; // first instruction
+    u32 last{0};  // last instruction
+    u32 end{0};   // one past the last instruction's final cell
+};
+
+// Splits code loaded at cell 0 into basic blocks, in address order. Leaders are
+// cell 0, every branch target or thread entry that starts a decoded
+// instruction, and the instruction after any branch, stop or thread switch. Decoding stops at the first cell that
+// is not a known opcode or whose operands are cut off; that cell and everything
+// after it is treated as data, and its index goes to outCodeEnd. Blocks are
+// contiguous, so a block that does not end in a branch or stop falls through
+// into the next one.
+std::vector<BasicBlock> findBasicBlocks(const u32* code, std::size_t count, std::size_t* outCodeEnd = nullptr);
+
+} // namespace vm32
@@ -1,6 +1,9 @@
 #pragma once
+#include <cmath>
+#include <string>
 #include <vector>
 #include "opcodes.h"
+#include "line_map.h"
 
 
 namespace vm32 {
@@ -13,8 +16,40 @@ struct BytecodeBuilder {
 
     std::size_t pc() const { return code.size(); }
 
+    // Source mapping (see line_map.h): code emitted after line(n) belongs to
+    // source line n; functions span beginFunction() to endFunction() and may nest.
+    LineMap lineMap;
+    std::vector<std::size_t> openFunctions;
+
+    BytecodeBuilder& line(u32 n) {
+        if (!lineMap.lines.empty() && lineMap.lines.back().addr == pc()) lineMap.lines.back().line = n;
+        else lineMap.lines.push_back({ static_cast<u32>(pc()), n });
+        return *this;
+    }
+    BytecodeBuilder& beginFunction(const std::string& name) {
+        openFunctions.push_back(lineMap.functions.size());
+        lineMap.functions.push_back({ name, static_cast<u32>(pc()), static_cast<u32>(pc()) });
+        return *this;
+    }
+    BytecodeBuilder& endFunction() {
+        if (!openFunctions.empty()) {
+            lineMap.functions[openFunctions.back()].end = static_cast<u32>(pc());
+            openFunctions.pop_back();
+        }
+        return *this;
+    }
+
     BytecodeBuilder& op(Op o) { code.push_back(static_cast<u32>(o)); return *this; }
     BytecodeBuilder& pushi(i32 v) { op(Op::PUSHI); emitU32(code, static_cast<u32>(v)); return *this; }
+    BytecodeBuilder& pushf(float v) { return pushi(f32ToCell(v)); }
+    // 16.16, rounded to nearest. Out-of-range values saturate and NaN gives 0, as FTOI does.
+    BytecodeBuilder& pushfx(double v) {
+        const double x = v * 65536.0 + (v < 0 ? -0.5 : 0.5);
+        if (std::isnan(x)) return pushi(0);
+        if (x >= 2147483647.0) return pushi(0x7FFFFFFF);
+        if (x <= -2147483648.0) return pushi(static_cast<i32>(0x80000000u));
+        return pushi(static_cast<i32>(x));
+    }
     BytecodeBuilder& pop() { return op(Op::POP); }
     BytecodeBuilder& dup() { return op(Op::DUP); }
     BytecodeBuilder& swap(){ return op(Op::SWAP); }
@@ -26,23 +61,95 @@ struct BytecodeBuilder {
     BytecodeBuilder& mul() { return op(Op::MUL); }
     BytecodeBuilder& div() { return op(Op::DIV); }
     BytecodeBuilder& mod() { return op(Op::MOD); }
+    BytecodeBuilder& divu(){ return op(Op::DIVU); }
+    BytecodeBuilder& modu(){ return op(Op::MODU); }
+
+    BytecodeBuilder& and_(){ return op(Op::AND); }
+    BytecodeBuilder& or_() { return op(Op::OR); }
+    BytecodeBuilder& xor_(){ return op(Op::XOR); }
+    BytecodeBuilder& not_(){ return op(Op::NOT); }
+    BytecodeBuilder& shl() { return op(Op::SHL); }
+    BytecodeBuilder& shr() { return op(Op::SHR); }
+    BytecodeBuilder& sar() { return op(Op::SAR); }
+    BytecodeBuilder& lerp8x4() { return op(Op::LERP8X4); }
+
+    BytecodeBuilder& vadd8()  { return op(Op::VADD8); }
+    BytecodeBuilder& vadds8() { return op(Op::VADDS8); }
+    BytecodeBuilder& vsubs8() { return op(Op::VSUBS8); }
+    BytecodeBuilder& vmul8()  { return op(Op::VMUL8); }
+    BytecodeBuilder& vmin8()  { return op(Op::VMIN8); }
+    BytecodeBuilder& vmax8()  { return op(Op::VMAX8); }
+    BytecodeBuilder& vavg8()  { return op(Op::VAVG8); }
+    BytecodeBuilder& vadd16() { return op(Op::VADD16); }
+    BytecodeBuilder& vadds16(){ return op(Op::VADDS16); }
+    BytecodeBuilder& vsubs16(){ return op(Op::VSUBS16); }
+    BytecodeBuilder& vmul16() { return op(Op::VMUL16); }
+    BytecodeBuilder& vmin16() { return op(Op::VMIN16); }
+    BytecodeBuilder& vmax16() { return op(Op::VMAX16); }
+    BytecodeBuilder& vavg16() { return op(Op::VAVG16); }
+
+    BytecodeBuilder& fadd() { return op(Op::FADD); }
+    BytecodeBuilder& fsub() { return op(Op::FSUB); }
+    BytecodeBuilder& fmul() { return op(Op::FMUL); }
+    BytecodeBuilder& fdiv() { return op(Op::FDIV); }
+    BytecodeBuilder& fneg() { return op(Op::FNEG); }
+    BytecodeBuilder& fsqrt(){ return op(Op::FSQRT); }
+    BytecodeBuilder& itof() { return op(Op::ITOF); }
+    BytecodeBuilder& ftoi() { return op(Op::FTOI); }
+    BytecodeBuilder& fcmp() { return op(Op::FCMP); }
+    BytecodeBuilder& fxmul(){ return op(Op::FXMUL); }
+    BytecodeBuilder& fxdiv(){ return op(Op::FXDIV); }
 
     BytecodeBuilder& print() { return op(Op::PRINT); }
+    BytecodeBuilder& syscall(u32 n) { op(Op::SYSCALL); emitU32(code, n); return *this; }
 
     BytecodeBuilder& jmp(u32 addr) { op(Op::JMP); emitU32(code, addr); return *this; }
     BytecodeBuilder& jz(u32 addr)  { op(Op::JZ);  emitU32(code, addr); return *this; }
     BytecodeBuilder& jnz(u32 addr) { op(Op::JNZ); emitU32(code, addr); return *this; }
 
+    BytecodeBuilder& jeq(u32 addr) { op(Op::JEQ); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jne(u32 addr) { op(Op::JNE); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jlt(u32 addr) { op(Op::JLT); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jle(u32 addr) { op(Op::JLE); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jgt(u32 addr) { op(Op::JGT); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jge(u32 addr) { op(Op::JGE); emitU32(code, addr); return *this; }
+
+    BytecodeBuilder& jeq_imm(i32 v, u32 addr) { op(Op::JEQ_IMM); emitU32(code, static_cast<u32>(v)); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jne_imm(i32 v, u32 addr) { op(Op::JNE_IMM); emitU32(code, static_cast<u32>(v)); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jlt_imm(i32 v, u32 addr) { op(Op::JLT_IMM); emitU32(code, static_cast<u32>(v)); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jle_imm(i32 v, u32 addr) { op(Op::JLE_IMM); emitU32(code, static_cast<u32>(v)); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jgt_imm(i32 v, u32 addr) { op(Op::JGT_IMM); emitU32(code, static_cast<u32>(v)); emitU32(code, addr); return *this; }
+    BytecodeBuilder& jge_imm(i32 v, u32 addr) { op(Op::JGE_IMM); emitU32(code, static_cast<u32>(v)); emitU32(code, addr); return *this; }
+
     BytecodeBuilder& cmpeq(){ return op(Op::CMP_EQ); }
     BytecodeBuilder& cmplt(){ return op(Op::CMP_LT); }
     BytecodeBuilder& cmpgt(){ return op(Op::CMP_GT); }
+    BytecodeBuilder& cmpltu(){ return op(Op::CMP_LTU); }
 
     BytecodeBuilder& halt() { return op(Op::HALT); }
+    BytecodeBuilder& halt_until_irq() { return op(Op::HALT_UNTIL_IRQ); }
+    BytecodeBuilder& reti() { return op(Op::RETI); }
+    BytecodeBuilder& spawn(u32 addr) { op(Op::SPAWN); emitU32(code, addr); return *this; }
+    BytecodeBuilder& yield() { return op(Op::YIELD); }
+    BytecodeBuilder& join() { return op(Op::JOIN); }
 
     BytecodeBuilder& load(u32 addr)  { op(Op::LOAD); emitU32(code, addr); return *this; }
     BytecodeBuilder& store(u32 addr) { op(Op::STORE); emitU32(code, addr); return *this; }
 
     BytecodeBuilder& store_ind() { return op(Op::STORE_IND); }
+    BytecodeBuilder& load_ind()  { return op(Op::LOAD_IND); }
+    BytecodeBuilder& load_idx(u32 base)  { op(Op::LOAD_IDX);  emitU32(code, base); return *this; }
+    BytecodeBuilder& store_idx(u32 base) { op(Op::STORE_IDX); emitU32(code, base); return *this; }
+    BytecodeBuilder& fb_xy() { return op(Op::FB_XY); }
+
+    BytecodeBuilder& load_acq()  { return op(Op::LOAD_ACQ); }
+    BytecodeBuilder& store_rel() { return op(Op::STORE_REL); }
+    BytecodeBuilder& cas()       { return op(Op::CAS); }
+    BytecodeBuilder& xadd()      { return op(Op::XADD); }
+
+    BytecodeBuilder& alloc()   { return op(Op::ALLOC); }
+    BytecodeBuilder& free_()   { return op(Op::FREE); }
+    BytecodeBuilder& realloc() { return op(Op::REALLOC); }
 };
 
 } // namespace vm32
@@ -0,0 +1,40 @@
+#include "disasm.h"
+
+#include <cstdio>
+
+#include "opcode_info.h"
+
+namespace vm32 {
+
+std::string disassembleAt(const u32* cells, std::size_t count, std::size_t pc, std::size_t* outLength) {
+    char buf[32];
+    if (pc >= count) {
+        if (outLength) *outLength = 1;
+        return "?";
+    }
+    OpInfo info;
+    if (!opInfo(cells[pc], info)) {
+        if (outLength) *outLength = 1;
+        std::snprintf(buf, sizeof(buf), ".word 0x%x", cells[pc]);
+        return buf;
+    }
+
+    std::string out = info.name;
+    for (u8 k = 1; k <= info.operands; ++k) {
+        out.push_back(' ');
+        if (pc + k >= count) {
+            out.push_back('?');
+            continue;
+        }
+        const u32 v = cells[pc + k];
+        const bool target = (info.flags & OPF_BRANCH) && k == info.operands;
+        const i32 n = static_cast<i32>(v);
+        if (target || n > 0xFFFF || n < -0xFFFF) std::snprintf(buf, sizeof(buf), "0x%04x", v);
+        else std::snprintf(buf, sizeof(buf), "%d", n);
+        out += buf;
+    }
+    if (outLength) *outLength = 1 + info.operands;
+    return out;
+}
+
+} // namespace vm32
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include "opcodes.h"
+
+namespace vm32 {
+
+// Formats the instruction at cells[pc] as "NAME op1 op2", with jump targets and
+// large operands in hex. Operands past `count` print as "?". Unknown opcodes
+// print as ".word 0x...". The instruction length in cells goes to outLength.
+std::string disassembleAt(const u32* cells, std::size_t count, std::size_t pc, std::size_t* outLength = nullptr);
+
+} // namespace vm32
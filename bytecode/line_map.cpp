@@ -0,0 +1,81 @@
+#include "line_map.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace vm32 {
+
+const LineMap::Function* LineMap::functionAt(u32 addr) const {
+    const Function* best = nullptr;
+    for (const Function& f : functions) {
+        if (addr >= f.start && addr < f.end && (!best || f.end - f.start < best->end - best->start)) best = &f;
+    }
+    return best;
+}
+
+u32 LineMap::lineAt(u32 addr) const {
+    auto it = std::upper_bound(lines.begin(), lines.end(), addr,
+                               [](u32 a, const Line& l) { return a < l.addr; });
+    return it == lines.begin() ? 0 : std::prev(it)->line;
+}
+
+bool saveLineMap(const LineMap& map, const std::string& path, std::string* outError) {
+    std::ofstream f(path);
+    if (!f) {
+        if (outError) *outError = "Failed to open for write: " + path;
+        return false;
+    }
+    if (!map.source.empty()) f << "source " << map.source << '\n';
+    for (const auto& fn : map.functions) f << "func " << fn.start << ' ' << fn.end << ' ' << fn.name << '\n';
+    for (const auto& l : map.lines) f << "line " << l.addr << ' ' << l.line << '\n';
+    if (!f) {
+        if (outError) *outError = "Failed to write line map: " + path;
+        return false;
+    }
+    return true;
+}
+
+bool loadLineMap(const std::string& path, LineMap& out, std::string* outError) {
+    std::ifstream f(path);
+    if (!f) {
+        if (outError) *outError = "Failed to open line map: " + path;
+        return false;
+    }
+
+    LineMap map;
+    std::string text;
+    for (std::size_t lineNo = 1; std::getline(f, text); ++lineNo) {
+        const std::size_t hash = text.find('#');
+        if (hash != std::string::npos) text.erase(hash);
+        text.erase(text.find_last_not_of(" \t\r") + 1);
+
+        std::istringstream ls(text);
+        std::string kind;
+        if (!(ls >> kind)) continue; // blank line
+        bool ok = true;
+        if (kind == "source") {
+            ok = std::getline(ls >> std::ws, map.source) && !map.source.empty();
+        } else if (kind == "func") {
+            LineMap::Function fn;
+            ok = (ls >> fn.start >> fn.end) && std::getline(ls >> std::ws, fn.name) && fn.start <= fn.end;
+            map.functions.push_back(fn);
+        } else if (kind == "line") {
+            LineMap::Line l;
+            ok = static_cast<bool>(ls >> l.addr >> l.line);
+            map.lines.push_back(l);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            if (outError) *outError = path + ":" + std::to_string(lineNo) + ": expected 'source', 'func' or 'line' record";
+            return false;
+        }
+    }
+    std::stable_sort(map.lines.begin(), map.lines.end(),
+                     [](const LineMap::Line& a, const LineMap::Line& b) { return a.addr < b.addr; });
+    out = std::move(map);
+    return true;
+}
+
+} // namespace vm32
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "opcodes.h"
+
+namespace vm32 {
+
+// Maps code addresses back to source for profiling and diagnostics. Emitted by
+// the compiler next to the bytecode (program.ljbc -> program.ljmap); the
+// BytecodeBuilder records one through line() and beginFunction()/endFunction().
+// Addresses are cell indices of the final code, so a map recorded before a
+// pass that moves code (e.g. fuseCompareBranches) no longer matches it.
+struct LineMap {
+    struct Function {
+        std::string name;
+        u32 start{0}; // first cell
+        u32 end{0};   // one past the last cell
+    };
+    struct Line {
+        u32 addr{0}; // first cell of the line's code; it runs up to the next entry
+        u32 line{0};
+    };
+
+    std::string source; // source file the lines refer to
+    std::vector<Function> functions;
+    std::vector<Line> lines; // sorted by addr
+
+    // Innermost function containing addr, or nullptr.
+    const Function* functionAt(u32 addr) const;
+    // Source line of addr, or 0 when unknown.
+    u32 lineAt(u32 addr) const;
+};
+
+// Text format, one record per line ('#' starts a comment). Paths and names run
+// to the end of the line, so they may contain spaces:
+//   source <path>
+//   func <start> <end> <name>
+//   line <addr> <line>
+bool saveLineMap(const LineMap& map, const std::string& path, std::string* outError = nullptr);
+
+bool loadLineMap(const std::string& path, LineMap& out, std::string* outError = nullptr);
+
+} // namespace vm32
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "opcodes.h"
+
+namespace vm32 {
+
+// Static description of each opcode, for tools that walk bytecode
+// (rewrite passes, disassembly) rather than execute it.
+enum OpFlags : u8 {
+    OPF_NONE   = 0,
+    OPF_BRANCH = 1 << 0, // last operand cell is an absolute jump target
+    OPF_COND   = 1 << 1, // branch may fall through to the next instruction
+    OPF_STOP   = 1 << 2, // execution does not continue at the next instruction
+    OPF_CODE   = 1 << 3, // last operand cell is a code address (an entry point), not a jump
+    OPF_SWITCH = 1 << 4, // may switch threads; this thread resumes at the next instruction
+};
+
+struct OpInfo {
+    const char* name;
+    u8 operands; // operand cells following the opcode cell
+    u8 flags;
+};
+
+// Returns false for cells that are not a known opcode.
+inline bool opInfo(u32 cell, OpInfo& out) {
+    if (cell > 0xFF) return false;
+    switch (static_cast<Op>(cell)) {
+        case Op::HALT:      out = { "HALT", 0, OPF_STOP }; return true;
+        case Op::PUSHI:     out = { "PUSHI", 1, OPF_NONE }; return true;
+        case Op::POP:       out = { "POP", 0, OPF_NONE }; return true;
+        case Op::HALT_UNTIL_IRQ: out = { "HALT_UNTIL_IRQ", 0, OPF_NONE }; return true;
+        case Op::SPAWN:     out = { "SPAWN", 1, OPF_CODE }; return true;
+        case Op::YIELD:     out = { "YIELD", 0, OPF_SWITCH }; return true;
+        case Op::JOIN:      out = { "JOIN", 0, OPF_SWITCH }; return true;
+
+        case Op::ADD:       out = { "ADD", 0, OPF_NONE }; return true;
+        case Op::SUB:       out = { "SUB", 0, OPF_NONE }; return true;
+        case Op::MUL:       out = { "MUL", 0, OPF_NONE }; return true;
+        case Op::DIV:       out = { "DIV", 0, OPF_NONE }; return true;
+        case Op::MOD:       out = { "MOD", 0, OPF_NONE }; return true;
+        case Op::NEG:       out = { "NEG", 0, OPF_NONE }; return true;
+        case Op::DUP:       out = { "DUP", 0, OPF_NONE }; return true;
+        case Op::SWAP:      out = { "SWAP", 0, OPF_NONE }; return true;
+        case Op::OVER:      out = { "OVER", 0, OPF_NONE }; return true;
+        case Op::DIVU:      out = { "DIVU", 0, OPF_NONE }; return true;
+        case Op::MODU:      out = { "MODU", 0, OPF_NONE }; return true;
+
+        case Op::PRINT:     out = { "PRINT", 0, OPF_NONE }; return true;
+        case Op::SYSCALL:   out = { "SYSCALL", 1, OPF_NONE }; return true;
+
+        case Op::JMP:       out = { "JMP", 1, OPF_BRANCH | OPF_STOP }; return true;
+        case Op::JZ:        out = { "JZ", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JNZ:       out = { "JNZ", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JEQ:       out = { "JEQ", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JNE:       out = { "JNE", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JLT:       out = { "JLT", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JLE:       out = { "JLE", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JGT:       out = { "JGT", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JGE:       out = { "JGE", 1, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JEQ_IMM:   out = { "JEQ_IMM", 2, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JNE_IMM:   out = { "JNE_IMM", 2, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JLT_IMM:   out = { "JLT_IMM", 2, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JLE_IMM:   out = { "JLE_IMM", 2, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JGT_IMM:   out = { "JGT_IMM", 2, OPF_BRANCH | OPF_COND }; return true;
+        case Op::JGE_IMM:   out = { "JGE_IMM", 2, OPF_BRANCH | OPF_COND }; return true;
+        case Op::RETI:      out = { "RETI", 0, OPF_STOP }; return true;
+
+        case Op::CMP_EQ:    out = { "CMP_EQ", 0, OPF_NONE }; return true;
+        case Op::CMP_LT:    out = { "CMP_LT", 0, OPF_NONE }; return true;
+        case Op::CMP_GT:    out = { "CMP_GT", 0, OPF_NONE }; return true;
+        case Op::CMP_LTU:   out = { "CMP_LTU", 0, OPF_NONE }; return true;
+
+        case Op::LOAD:      out = { "LOAD", 1, OPF_NONE }; return true;
+        case Op::STORE:     out = { "STORE", 1, OPF_NONE }; return true;
+        case Op::STORE_IND: out = { "STORE_IND", 0, OPF_NONE }; return true;
+        case Op::LOAD_IND:  out = { "LOAD_IND", 0, OPF_NONE }; return true;
+        case Op::LOAD_IDX:  out = { "LOAD_IDX", 1, OPF_NONE }; return true;
+        case Op::STORE_IDX: out = { "STORE_IDX", 1, OPF_NONE }; return true;
+        case Op::FB_XY:     out = { "FB_XY", 0, OPF_NONE }; return true;
+        case Op::LOAD_ACQ:  out = { "LOAD_ACQ", 0, OPF_NONE }; return true;
+        case Op::STORE_REL: out = { "STORE_REL", 0, OPF_NONE }; return true;
+        case Op::CAS:       out = { "CAS", 0, OPF_NONE }; return true;
+        case Op::XADD:      out = { "XADD", 0, OPF_NONE }; return true;
+        case Op::ALLOC:     out = { "ALLOC", 0, OPF_NONE }; return true;
+        case Op::FREE:      out = { "FREE", 0, OPF_NONE }; return true;
+        case Op::REALLOC:   out = { "REALLOC", 0, OPF_NONE }; return true;
+
+        case Op::AND:       out = { "AND", 0, OPF_NONE }; return true;
+        case Op::OR:        out = { "OR", 0, OPF_NONE }; return true;
+        case Op::XOR:       out = { "XOR", 0, OPF_NONE }; return true;
+        case Op::NOT:       out = { "NOT", 0, OPF_NONE }; return true;
+        case Op::SHL:       out = { "SHL", 0, OPF_NONE }; return true;
+        case Op::SHR:       out = { "SHR", 0, OPF_NONE }; return true;
+        case Op::SAR:       out = { "SAR", 0, OPF_NONE }; return true;
+        case Op::LERP8X4:   out = { "LERP8X4", 0, OPF_NONE }; return true;
+
+        case Op::VADD8:     out = { "VADD8", 0, OPF_NONE }; return true;
+        case Op::VADDS8:    out = { "VADDS8", 0, OPF_NONE }; return true;
+        case Op::VSUBS8:    out = { "VSUBS8", 0, OPF_NONE }; return true;
+        case Op::VMUL8:     out = { "VMUL8", 0, OPF_NONE }; return true;
+        case Op::VMIN8:     out = { "VMIN8", 0, OPF_NONE }; return true;
+        case Op::VMAX8:     out = { "VMAX8", 0, OPF_NONE }; return true;
+        case Op::VAVG8:     out = { "VAVG8", 0, OPF_NONE }; return true;
+        case Op::VADD16:    out = { "VADD16", 0, OPF_NONE }; return true;
+        case Op::VADDS16:   out = { "VADDS16", 0, OPF_NONE }; return true;
+        case Op::VSUBS16:   out = { "VSUBS16", 0, OPF_NONE }; return true;
+        case Op::VMUL16:    out = { "VMUL16", 0, OPF_NONE }; return true;
+        case Op::VMIN16:    out = { "VMIN16", 0, OPF_NONE }; return true;
+        case Op::VMAX16:    out = { "VMAX16", 0, OPF_NONE }; return true;
+        case Op::VAVG16:    out = { "VAVG16", 0, OPF_NONE }; return true;
+
+        case Op::FADD:      out = { "FADD", 0, OPF_NONE }; return true;
+        case Op::FSUB:      out = { "FSUB", 0, OPF_NONE }; return true;
+        case Op::FMUL:      out = { "FMUL", 0, OPF_NONE }; return true;
+        case Op::FDIV:      out = { "FDIV", 0, OPF_NONE }; return true;
+        case Op::FNEG:      out = { "FNEG", 0, OPF_NONE }; return true;
+        case Op::FSQRT:     out = { "FSQRT", 0, OPF_NONE }; return true;
+        case Op::ITOF:      out = { "ITOF", 0, OPF_NONE }; return true;
+        case Op::FTOI:      out = { "FTOI", 0, OPF_NONE }; return true;
+        case Op::FCMP:      out = { "FCMP", 0, OPF_NONE }; return true;
+        case Op::FXMUL:     out = { "FXMUL", 0, OPF_NONE }; return true;
+        case Op::FXDIV:     out = { "FXDIV", 0, OPF_NONE }; return true;
+    }
+    return false;
+}
+
+// Cells an instruction pops and pushes, for translators that check the stack
+// once per block. Not meaningful for instructions that stop or switch threads.
+inline void stackEffect(Op op, int& pops, int& pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (op) {
+        case Op::PUSHI: case Op::LOAD: pushes = 1; break;
+        case Op::POP: case Op::STORE: case Op::JZ: case Op::JNZ:
+        case Op::JEQ_IMM: case Op::JNE_IMM: case Op::JLT_IMM: case Op::JLE_IMM: case Op::JGT_IMM: case Op::JGE_IMM:
+            pops = 1; break;
+        case Op::DUP: pops = 1; pushes = 2; break;
+        case Op::SWAP: pops = 2; pushes = 2; break;
+        case Op::OVER: pops = 2; pushes = 3; break;
+        case Op::NEG: case Op::NOT: case Op::FNEG: case Op::FSQRT: case Op::ITOF: case Op::FTOI:
+        case Op::LOAD_IND: case Op::LOAD_IDX:
+            pops = 1; pushes = 1; break;
+        case Op::STORE_IND: case Op::STORE_IDX:
+        case Op::JEQ: case Op::JNE: case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+            pops = 2; break;
+        case Op::LERP8X4: pops = 3; pushes = 1; break;
+        case Op::JMP: break;
+        default: pops = 2; pushes = 1; break; // binary ops, compares, FB_XY
+    }
+}
+
+} // namespace vm32
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <string>
 
@@ -10,10 +11,18 @@ using u8  = std::uint8_t;
 using u32 = std::uint32_t;
 using i32 = std::int32_t;
 
+// Bit-cast helpers for f32 values held in i32 cells.
+inline i32 f32ToCell(float f) { i32 c; std::memcpy(&c, &f, sizeof c); return c; }
+inline float cellToF32(i32 c) { float f; std::memcpy(&f, &c, sizeof f); return f; }
+
 enum class Op : u8 {
     HALT = 0x00,
     PUSHI = 0x01,     // push immediate i32 (4 bytes)
     POP   = 0x02,
+    HALT_UNTIL_IRQ = 0x03, // park until an enabled interrupt is raised
+    SPAWN = 0x04,     // operand: entry addr; pops arg, pushes new thread id (0 = no free slot)
+    YIELD = 0x05,     // switch to the next ready thread
+    JOIN  = 0x06,     // pops thread id, waits for it to finish, pushes its result
 
     ADD = 0x10,
     SUB = 0x11,
@@ -24,20 +33,93 @@ enum class Op : u8 {
     DUP = 0x16,
     SWAP= 0x17,
     OVER= 0x18,     // duplicate second stack item
+    DIVU = 0x19,      // unsigned int division
+    MODU = 0x1A,      // unsigned int modulo
 
     PRINT = 0x20,     // print top as i32
+    SYSCALL = 0x21,   // call host function u32 n (see VM::registerSyscall)
 
     JMP = 0x30,       // absolute byte offset (u32)
     JZ  = 0x31,       // pop cond; if zero -> jump abs(u32)
     JNZ = 0x32,       // pop cond; if non-zero -> jump abs(u32)
 
+    // Fused compare-and-branch: pop b, pop a; jump abs(u32) if a op b
+    JEQ = 0x33,
+    JNE = 0x34,
+    JLT = 0x35,
+    JLE = 0x36,
+    JGT = 0x37,
+    JGE = 0x38,
+    // Immediate forms: i32 imm, u32 addr; pop a; jump if a op imm
+    JEQ_IMM = 0x39,
+    JNE_IMM = 0x3A,
+    JLT_IMM = 0x3B,
+    JLE_IMM = 0x3C,
+    JGT_IMM = 0x3D,
+    JGE_IMM = 0x3E,
+    RETI    = 0x3F,   // return from interrupt handler: pop ip
+
     CMP_EQ = 0x40,    // push 1 if a==b else 0
     CMP_LT = 0x41,    // push 1 if a<b else 0
     CMP_GT = 0x42,    // push 1 if a>b else 0
+    CMP_LTU = 0x43,   // push 1 if a<b (unsigned) else 0
 
     LOAD  = 0x50,    // load from mem[u32 addr]
     STORE = 0x51,    // store to mem[u32 addr] (pop value)
-    STORE_IND = 0x52 // store to mem[addr] where addr is popped from stack (value below it)
+    STORE_IND = 0x52, // store to mem[addr] where addr is popped from stack (value below it)
+    LOAD_IND  = 0x53, // pop addr; push mem[addr]
+    LOAD_IDX  = 0x54, // pop index; push mem[u32 base + index]
+    STORE_IDX = 0x55, // pop index, pop value; mem[u32 base + index] = value
+    FB_XY     = 0x56, // pop y, pop x; push FB_BASE + y*FB_WIDTH + x (bounds-checked)
+    // Atomic memory access, for programs running on several cores (see VM::CORE_ID_ADDR)
+    LOAD_ACQ  = 0x57, // pop addr; push mem[addr] (acquire)
+    STORE_REL = 0x58, // pop addr, pop value; mem[addr] = value (release)
+    CAS       = 0x59, // pop addr, pop expected, pop desired; if mem[addr]==expected store desired; push old
+    XADD      = 0x5A, // pop addr, pop delta; mem[addr] += delta; push old
+    // Heap (see VM::setHeapRegion()); pointers are cell addresses, 0 = none
+    ALLOC     = 0x5B, // pop n; push a block of at least n cells, or 0
+    FREE      = 0x5C, // pop p; give back a block from ALLOC (0 is ignored)
+    REALLOC   = 0x5D, // pop n, pop p; push p resized to n cells, contents kept (0 = no room, p kept; n = 0 frees p)
+
+    AND = 0x60,
+    OR  = 0x61,
+    XOR = 0x62,
+    NOT = 0x63,       // bitwise complement of top
+    SHL = 0x64,       // a << (b & 31)
+    SHR = 0x65,       // logical a >> (b & 31)
+    SAR = 0x66,       // arithmetic a >> (b & 31)
+    LERP8X4 = 0x67,   // pop t (0..256), b, a; per 8-bit channel a + (b - a) * t / 256
+
+    // Packed lanes: pop b, pop a, push a op b per unsigned lane
+    VADD8   = 0x70,   // 4x8-bit wrapping add
+    VADDS8  = 0x71,   // 4x8-bit saturating add
+    VSUBS8  = 0x72,   // 4x8-bit saturating subtract (clamps at 0)
+    VMUL8   = 0x73,   // 4x8-bit scaled multiply, round(a*b/255)
+    VMIN8   = 0x74,
+    VMAX8   = 0x75,
+    VAVG8   = 0x76,   // 4x8-bit rounding average
+    VADD16  = 0x78,   // 2x16-bit variants of the above
+    VADDS16 = 0x79,
+    VSUBS16 = 0x7A,
+    VMUL16  = 0x7B,   // round(a*b/65535)
+    VMIN16  = 0x7C,
+    VMAX16  = 0x7D,
+    VAVG16  = 0x7E,
+
+    // IEEE f32 values stored bit-cast in cells
+    FADD  = 0x80,
+    FSUB  = 0x81,
+    FMUL  = 0x82,
+    FDIV  = 0x83,
+    FNEG  = 0x84,
+    FSQRT = 0x85,
+    ITOF  = 0x86,     // i32 -> f32
+    FTOI  = 0x87,     // f32 -> i32 (truncate, saturating; NaN -> 0)
+    FCMP  = 0x88,     // pop b, pop a; push -1 (a<b), 0 (a==b), 1 (a>b), 2 (unordered)
+
+    // Signed 16.16 fixed point (plain ADD/SUB/NEG work unchanged)
+    FXMUL = 0x90,     // (a * b) >> 16 with a 64-bit intermediate
+    FXDIV = 0x91      // (a << 16) / b with a 64-bit intermediate
 };
 
 } // namespace vm32
@@ -0,0 +1,130 @@
+#include "peephole.h"
+
+#include "opcode_info.h"
+
+namespace vm32 {
+
+namespace {
+
+void setError(std::string* outError, const std::string& msg) {
+    if (outError) *outError = msg;
+}
+
+// Fused branch for CMP_xx followed by JZ (jumpIfTrue == false) or JNZ.
+bool fusedBranch(u32 cmp, bool jumpIfTrue, Op& out) {
+    switch (static_cast<Op>(cmp)) {
+        case Op::CMP_EQ: out = jumpIfTrue ? Op::JEQ : Op::JNE; return true;
+        case Op::CMP_LT: out = jumpIfTrue ? Op::JLT : Op::JGE; return true;
+        case Op::CMP_GT: out = jumpIfTrue ? Op::JGT : Op::JLE; return true;
+        default: return false;
+    }
+}
+
+Op immediateForm(Op fused) {
+    switch (fused) {
+        case Op::JEQ: return Op::JEQ_IMM;
+        case Op::JNE: return Op::JNE_IMM;
+        case Op::JLT: return Op::JLT_IMM;
+        case Op::JLE: return Op::JLE_IMM;
+        case Op::JGT: return Op::JGT_IMM;
+        default:      return Op::JGE_IMM;
+    }
+}
+
+} // namespace
+
+bool fuseCompareBranches(std::vector<u32>& code, std::size_t* outFused, std::string* outError) {
+    if (outFused) *outFused = 0;
+    const std::size_t n = code.size();
+
+    // Decode instruction starts and collect jump targets.
+    std::vector<std::size_t> starts;
+    std::vector<bool> isStart(n + 1, false), isTarget(n + 1, false);
+    for (std::size_t pc = 0; pc < n;) {
+        OpInfo info;
+        if (!opInfo(code[pc], info)) {
+            setError(outError, "Unknown opcode at cell " + std::to_string(pc));
+            return false;
+        }
+        if (pc + info.operands >= n) {
+            setError(outError, "Truncated instruction at cell " + std::to_string(pc));
+            return false;
+        }
+        starts.push_back(pc);
+        isStart[pc] = true;
+        if (info.flags & (OPF_BRANCH | OPF_CODE)) {
+            const u32 target = code[pc + info.operands];
+            if (target <= n) isTarget[target] = true;
+        }
+        pc += 1 + info.operands;
+    }
+    isStart[n] = true;
+    for (std::size_t pc = 0; pc <= n; ++pc) {
+        if (isTarget[pc] && !isStart[pc]) {
+            setError(outError, "Jump into the middle of an instruction at cell " + std::to_string(pc));
+            return false;
+        }
+    }
+
+    auto isCondJump = [&](std::size_t pc) {
+        return code[pc] == static_cast<u32>(Op::JZ) || code[pc] == static_cast<u32>(Op::JNZ);
+    };
+
+    // Emit the rewritten stream, remembering where every old instruction went.
+    std::vector<u32> out;
+    out.reserve(n);
+    std::vector<u32> newAddr(n + 1, 0);
+    std::vector<std::size_t> branchOperands; // positions in `out` holding old jump targets
+    std::size_t fused = 0;
+
+    for (std::size_t i = 0; i < starts.size();) {
+        const std::size_t pc = starts[i];
+        const u32 at = static_cast<u32>(out.size());
+        Op f;
+
+        // PUSHI k ; CMP_xx ; JZ/JNZ addr  ->  Jxx_IMM k addr
+        if (i + 2 < starts.size() && code[pc] == static_cast<u32>(Op::PUSHI) &&
+            !isTarget[starts[i + 1]] && !isTarget[starts[i + 2]] && isCondJump(starts[i + 2]) &&
+            fusedBranch(code[starts[i + 1]], code[starts[i + 2]] == static_cast<u32>(Op::JNZ), f)) {
+            newAddr[pc] = newAddr[starts[i + 1]] = newAddr[starts[i + 2]] = at;
+            out.push_back(static_cast<u32>(immediateForm(f)));
+            out.push_back(code[pc + 1]);
+            branchOperands.push_back(out.size());
+            out.push_back(code[starts[i + 2] + 1]);
+            ++fused;
+            i += 3;
+            continue;
+        }
+
+        // CMP_xx ; JZ/JNZ addr  ->  Jxx addr
+        if (i + 1 < starts.size() && !isTarget[starts[i + 1]] && isCondJump(starts[i + 1]) &&
+            fusedBranch(code[pc], code[starts[i + 1]] == static_cast<u32>(Op::JNZ), f)) {
+            newAddr[pc] = newAddr[starts[i + 1]] = at;
+            out.push_back(static_cast<u32>(f));
+            branchOperands.push_back(out.size());
+            out.push_back(code[starts[i + 1] + 1]);
+            ++fused;
+            i += 2;
+            continue;
+        }
+
+        OpInfo info;
+        opInfo(code[pc], info);
+        newAddr[pc] = at;
+        for (u8 k = 0; k <= info.operands; ++k) out.push_back(code[pc + k]);
+        if (info.flags & (OPF_BRANCH | OPF_CODE)) branchOperands.push_back(out.size() - 1);
+        ++i;
+    }
+    newAddr[n] = static_cast<u32>(out.size());
+
+    // Targets outside the program (e.g. into data) are left as they were.
+    for (std::size_t pos : branchOperands) {
+        if (out[pos] <= n) out[pos] = newAddr[out[pos]];
+    }
+
+    code.swap(out);
+    if (outFused) *outFused = fused;
+    return true;
+}
+
+} // namespace vm32
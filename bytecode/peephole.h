@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "opcodes.h"
+
+namespace vm32 {
+
+// Rewrites CMP_EQ/CMP_LT/CMP_GT followed by JZ/JNZ into the fused JEQ..JGE
+// branches, and PUSHI k + CMP + JZ/JNZ into the JEQ_IMM..JGE_IMM forms.
+// Jump targets and SPAWN entry points are relocated to the shortened code.
+// Cells are treated as code loaded at cell 0, so a jump target is a cell index.
+//
+// A pair is only fused when nothing jumps between its instructions. If the
+// code cannot be decoded (unknown opcode, truncated operand, jump into the
+// middle of an instruction) it is left untouched and false is returned.
+// Code addresses held as data (e.g. interrupt vectors stored with PUSHI +
+// STORE) are not relocated, so do not run the pass on such programs.
+bool fuseCompareBranches(std::vector<u32>& code, std::size_t* outFused = nullptr, std::string* outError = nullptr);
+
+} // namespace vm32
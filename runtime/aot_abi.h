@@ -0,0 +1,76 @@
+#pragma once
+
+/* Interface between the VM and native code generated by the aot tool from an
+ * LJBC program. Plain C so a module can come from any compiler.
+ *
+ * A module exports lj_aot_program(). The VM enters run() only at one of the
+ * program's entry addresses, with the stack in memory as the interpreter left
+ * it. run() executes whole straight-line runs natively and returns:
+ *   LJ_AOT_BUDGET    at an entry point, because the next run would take
+ *                    steps past budget
+ *   LJ_AOT_FALLBACK  before an instruction it does not handle (PRINT, SYSCALL,
+ *                    HALT, interrupts, threads, atomics, heap operations,
+ *                    device registers) or that would fault; the interpreter
+ *                    executes it and reports any fault exactly as it would
+ *                    without the module
+ * with ip, sp and steps (instructions executed) written back. Native code
+ * assumes the program does not modify its own code.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LJ_AOT_ABI_VERSION 2
+
+enum {
+    LJ_AOT_BUDGET = 0,
+    LJ_AOT_FALLBACK = 1
+};
+
+typedef struct LjAotState {
+    int32_t* mem;      /* VM memory, MEM_SIZE cells */
+    uint32_t ip;
+    uint32_t sp;
+    uint32_t stackLo;  /* running thread's stack bounds */
+    uint32_t stackHi;
+    uint64_t budget;   /* in: instructions available */
+    uint64_t steps;    /* out: instructions executed */
+} LjAotState;
+
+typedef struct LjAotProgram {
+    uint32_t abiVersion;    /* LJ_AOT_ABI_VERSION */
+    uint32_t codeSize;      /* cells of the translated program */
+    uint64_t programHash;   /* lj_aot_hash() of those cells */
+    const uint32_t* entries; /* addresses run() accepts, ascending */
+    uint32_t entryCount;
+    int (*run)(LjAotState* state);
+} LjAotProgram;
+
+typedef const LjAotProgram* (*LjAotProgramFn)(void);
+#define LJ_AOT_PROGRAM_SYMBOL "lj_aot_program"
+
+#if defined(_WIN32)
+#define LJ_AOT_EXPORT __declspec(dllexport)
+#else
+#define LJ_AOT_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* 64-bit FNV-1a over the cells as little-endian bytes. */
+static inline uint64_t lj_aot_hash(const uint32_t* cells, size_t count) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count; ++i) {
+        for (unsigned b = 0; b < 4; ++b) {
+            h ^= (cells[i] >> (8 * b)) & 0xFFu;
+            h *= 0x100000001b3ull;
+        }
+    }
+    return h;
+}
+
+#ifdef __cplusplus
+}
+#endif
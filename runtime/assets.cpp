@@ -0,0 +1,124 @@
+#include "assets.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "input_record.h"
+
+namespace vm32 {
+
+namespace {
+
+constexpr std::array<std::uint8_t, 8> kMagic = { 'L','J','A','C','\r','\n',0x1A,'\n' };
+constexpr u32 kVersion = 1;
+constexpr std::size_t kHeaderSize = 8 + 4 + 8 + 4 + 4;
+
+void setError(std::string* outError, const std::string& msg) {
+    if (outError) *outError = msg;
+}
+
+bool readFile(const std::string& path, std::vector<std::uint8_t>& out) {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) return false; // directories open but cannot be read
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    const std::streamoff size = file.tellg();
+    if (size < 0) return false;
+    out.resize(static_cast<std::size_t>(size));
+    file.seekg(0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(out.size())));
+}
+
+std::uint64_t getLE(const std::uint8_t* p, unsigned bytes) {
+    std::uint64_t v = 0;
+    for (unsigned i = 0; i < bytes; ++i) v |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+void putLE(std::vector<std::uint8_t>& out, std::uint64_t v, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i) out.push_back(static_cast<std::uint8_t>((v >> (8 * i)) & 0xFF));
+}
+
+std::string cachePath(const std::string& dir, std::uint64_t hash) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.ljac", static_cast<unsigned long long>(hash));
+    return (std::filesystem::path(dir) / name).string();
+}
+
+bool readCache(const std::string& path, std::uint64_t hash, Image& out) {
+    std::vector<std::uint8_t> buf;
+    if (!readFile(path, buf) || buf.size() < kHeaderSize || !std::equal(kMagic.begin(), kMagic.end(), buf.begin())) return false;
+    const std::uint8_t* p = buf.data() + kMagic.size();
+    if (getLE(p, 4) != kVersion || getLE(p + 4, 8) != hash) return false;
+    const u32 width = static_cast<u32>(getLE(p + 12, 4));
+    const u32 height = static_cast<u32>(getLE(p + 16, 4));
+    const std::size_t cells = static_cast<std::size_t>(width) * height;
+    if ((buf.size() - kHeaderSize) / 4 != cells || (buf.size() - kHeaderSize) % 4 != 0) return false;
+    out.width = width;
+    out.height = height;
+    out.cells.resize(cells);
+    for (std::size_t i = 0; i < cells; ++i) out.cells[i] = static_cast<i32>(getLE(buf.data() + kHeaderSize + 4 * i, 4));
+    return true;
+}
+
+void writeCache(const std::string& dir, const std::string& path, std::uint64_t hash, const Image& img) {
+    std::vector<std::uint8_t> buf(kMagic.begin(), kMagic.end());
+    buf.reserve(kHeaderSize + img.cells.size() * 4);
+    putLE(buf, kVersion, 4);
+    putLE(buf, hash, 8);
+    putLE(buf, img.width, 4);
+    putLE(buf, img.height, 4);
+    for (i32 c : img.cells) putLE(buf, static_cast<u32>(c), 4);
+
+    // Written under a temporary name, so a reader never sees half a file.
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file.write(reinterpret_cast<const char*>(buf.data()), static_cast<std::streamsize>(buf.size()))) return;
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+} // namespace
+
+bool loadAsset(const std::string& path, const std::string& cacheDir, Image& out, bool* outFromCache, std::string* outError) {
+    if (outFromCache) *outFromCache = false;
+    std::vector<std::uint8_t> bytes;
+    if (!readFile(path, bytes)) {
+        setError(outError, "Failed to open for read: " + path);
+        return false;
+    }
+
+    if (!isPng(bytes.data(), bytes.size())) {
+        out.width = static_cast<u32>((bytes.size() + 3) / 4);
+        out.height = 1;
+        out.cells.assign(out.width, 0);
+        for (std::size_t i = 0; i < bytes.size(); ++i) {
+            out.cells[i / 4] |= static_cast<i32>(static_cast<u32>(bytes[i]) << (8 * (i % 4)));
+        }
+        return true;
+    }
+
+    const std::uint64_t hash = fnv1a64(bytes.data(), bytes.size());
+    const std::string cached = cacheDir.empty() ? std::string() : cachePath(cacheDir, hash);
+    if (!cached.empty() && readCache(cached, hash, out)) {
+        if (outFromCache) *outFromCache = true;
+        return true;
+    }
+    std::string err;
+    if (!decodePng(bytes.data(), bytes.size(), out, &err)) {
+        setError(outError, path + ": " + err);
+        return false;
+    }
+    if (!cached.empty()) writeCache(cacheDir, cached, hash, out);
+    return true;
+}
+
+} // namespace vm32
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "png.h"
+
+namespace vm32 {
+
+// Asset stage: files turned into VM cells once, for VM::writeMem() at load
+// time or VM::setDmaBlob(). A PNG (by signature) decodes to ARGB8888 cells;
+// any other file is taken as raw little-endian cells, the last one zero-padded,
+// and comes back as a width x 1 image. With a cache directory, decoded PNGs are
+// kept there as <content hash>.ljac, so an unchanged image is not decoded
+// again; cache files that cannot be written are skipped.
+//
+// Cache file format:
+//   magic[8]   = "LJAC\r\n\x1A\n"
+//   version    = u32 (currently 1)
+//   sourceHash = u64, fnv1a64() of the PNG file
+//   width      = u32
+//   height     = u32
+//   cells      = width * height u32 ARGB8888
+// Fixed-width fields are little-endian.
+bool loadAsset(const std::string& path, const std::string& cacheDir, Image& out, bool* outFromCache = nullptr,
+               std::string* outError = nullptr);
+
+} // namespace vm32
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../bytecode/opcodes.h"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace vm32 {
+
+// Atomic access to plain i32 memory cells, for the multi-core opcodes. VM
+// memory is a std::vector<i32> shared between cores, so these use compiler
+// intrinsics on the cell itself (std::atomic_ref needs C++20).
+namespace atomics {
+
+#if defined(__GNUC__) || defined(__clang__)
+
+inline i32 loadAcquire(const i32* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline void storeRelease(i32* p, i32 v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+// Wrapping add; returns the previous value.
+inline i32 fetchAdd(i32* p, i32 v) {
+    return static_cast<i32>(__atomic_fetch_add(reinterpret_cast<u32*>(p), static_cast<u32>(v), __ATOMIC_SEQ_CST));
+}
+
+// Stores desired if *p == expected; returns the previous value either way.
+inline i32 compareExchange(i32* p, i32 expected, i32 desired) {
+    __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
+#elif defined(_MSC_VER)
+
+// x86/x64 loads and stores of aligned 32-bit cells are already acquire/release;
+// the compiler barriers keep the compiler from reordering around them.
+inline i32 loadAcquire(const i32* p) {
+    const i32 v = *reinterpret_cast<const volatile long*>(p);
+    _ReadWriteBarrier();
+    return v;
+}
+inline void storeRelease(i32* p, i32 v) {
+    _ReadWriteBarrier();
+    *reinterpret_cast<volatile long*>(p) = v;
+}
+inline i32 fetchAdd(i32* p, i32 v) { return _InterlockedExchangeAdd(reinterpret_cast<volatile long*>(p), v); }
+inline i32 compareExchange(i32* p, i32 expected, i32 desired) {
+    return _InterlockedCompareExchange(reinterpret_cast<volatile long*>(p), desired, expected);
+}
+
+#else
+#error "No atomic intrinsics for this compiler"
+#endif
+
+} // namespace atomics
+
+} // namespace vm32
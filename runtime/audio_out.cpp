@@ -0,0 +1,59 @@
+#include "audio_out.h"
+
+#include <cstring>
+
+namespace vm32 {
+
+bool AudioOut::open(std::string* outError) {
+    if (m_device != 0) return true;
+
+    SDL_AudioSpec want{};
+    want.freq = static_cast<int>(VM::AUDIO_RATE);
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 512;
+    want.callback = &AudioOut::callback;
+    want.userdata = this;
+
+    SDL_AudioSpec have{};
+    m_device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+    if (m_device == 0) {
+        if (outError) *outError = std::string("SDL_OpenAudioDevice Error: ") + SDL_GetError();
+        return false;
+    }
+    SDL_PauseAudioDevice(m_device, 0);
+    return true;
+}
+
+void AudioOut::close() {
+    if (m_device != 0) {
+        SDL_CloseAudioDevice(m_device);
+        m_device = 0;
+    }
+}
+
+std::size_t AudioOut::pump(VM& vm, std::size_t maxSamples) {
+    std::int16_t chunk[256];
+    std::size_t moved = 0;
+    while (moved < maxSamples) {
+        std::size_t want = m_ring.space();
+        if (want == 0) break;
+        if (want > maxSamples - moved) want = maxSamples - moved;
+        if (want > sizeof(chunk) / sizeof(chunk[0])) want = sizeof(chunk) / sizeof(chunk[0]);
+        const std::size_t n = vm.readAudio(chunk, want);
+        if (n == 0) break;
+        m_ring.write(chunk, n);
+        moved += n;
+    }
+    return moved;
+}
+
+void SDLCALL AudioOut::callback(void* user, Uint8* stream, int len) {
+    AudioOut* self = static_cast<AudioOut*>(user);
+    std::int16_t* out = reinterpret_cast<std::int16_t*>(stream);
+    const std::size_t want = static_cast<std::size_t>(len) / sizeof(std::int16_t);
+    const std::size_t got = self->m_ring.read(out, want);
+    if (got < want) std::memset(out + got, 0, (want - got) * sizeof(std::int16_t));
+}
+
+} // namespace vm32
@@ -0,0 +1,45 @@
+#pragma once
+#include <SDL.h>
+#include <cstdint>
+#include <string>
+
+#include "spsc_ring.h"
+#include "vm.h"
+
+namespace vm32 {
+
+// SDL audio device fed from a VM's memory-mapped audio ring.
+//
+// The VM ring lives in plain VM memory, which only the VM thread touches, so
+// pump() (called on the VM thread, e.g. once per frame) moves new samples into
+// a host-side SPSC ring. The SDL callback reads that ring from the audio thread
+// without locking; on underrun it plays silence rather than waiting.
+//
+// Works with any SDL audio driver, including SDL_AUDIODRIVER=dummy or disk
+// for headless runs.
+class AudioOut {
+public:
+    AudioOut() : m_ring(HOST_BUFFER_SAMPLES) {}
+    ~AudioOut() { close(); }
+    AudioOut(const AudioOut&) = delete;
+    AudioOut& operator=(const AudioOut&) = delete;
+
+    // SDL_INIT_AUDIO must already be initialised.
+    bool open(std::string* outError = nullptr);
+    void close();
+    bool isOpen() const { return m_device != 0; }
+
+    // Move up to maxSamples samples from the VM's audio ring into the device
+    // queue, as many as fit. Returns the number moved.
+    std::size_t pump(VM& vm, std::size_t maxSamples = HOST_BUFFER_SAMPLES);
+
+    static constexpr std::size_t HOST_BUFFER_SAMPLES = 8192;
+
+private:
+    static void SDLCALL callback(void* user, Uint8* stream, int len);
+
+    SpscRing<std::int16_t> m_ring;
+    SDL_AudioDeviceID m_device{0};
+};
+
+} // namespace vm32
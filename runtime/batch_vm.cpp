@@ -0,0 +1,522 @@
+#include "batch_vm.h"
+#include "packed_lanes.h"
+#include <algorithm>
+#include <cmath>
+
+namespace vm32 {
+
+namespace {
+
+constexpr u32 MEM_SIZE = VM::MEM_SIZE;
+
+inline bool branchTaken(Op op, i32 a, i32 b) {
+    switch (op) {
+        case Op::JEQ: case Op::JEQ_IMM: return a == b;
+        case Op::JNE: case Op::JNE_IMM: return a != b;
+        case Op::JLT: case Op::JLT_IMM: return a < b;
+        case Op::JLE: case Op::JLE_IMM: return a <= b;
+        case Op::JGT: case Op::JGT_IMM: return a > b;
+        case Op::JGE: case Op::JGE_IMM: return a >= b;
+        default: return false;
+    }
+}
+
+inline i32 wrap(u32 v) { return static_cast<i32>(v); }
+
+inline i32 ftoi(i32 cell) {
+    const float f = cellToF32(cell);
+    if (std::isnan(f)) return 0;
+    if (f >= 2147483648.0f) return 0x7FFFFFFF;
+    if (f <= -2147483648.0f) return static_cast<i32>(0x80000000u);
+    return static_cast<i32>(f);
+}
+
+// The interpreter's stack underflow messages, so a lane faults as VM::run() would.
+const char* underflow(Op op) {
+    switch (op) {
+        case Op::NEG: return "Stack underflow (NEG)";
+        case Op::NOT: return "Stack underflow (NOT)";
+        case Op::CMP_EQ: case Op::CMP_LT: case Op::CMP_GT: case Op::CMP_LTU:
+            return "Stack underflow (cmp)";
+        case Op::FADD: case Op::FSUB: case Op::FMUL: case Op::FDIV: case Op::FCMP:
+        case Op::FNEG: case Op::FSQRT: case Op::ITOF: case Op::FTOI:
+            return "Stack underflow (float)";
+        case Op::FXMUL: case Op::FXDIV: return "Stack underflow (fixed)";
+        case Op::VADD8: case Op::VADDS8: case Op::VSUBS8: case Op::VMUL8:
+        case Op::VMIN8: case Op::VMAX8: case Op::VAVG8:
+        case Op::VADD16: case Op::VADDS16: case Op::VSUBS16: case Op::VMUL16:
+        case Op::VMIN16: case Op::VMAX16: case Op::VAVG16:
+            return "Stack underflow (packed)";
+        case Op::LOAD_IND: return "Stack underflow (LOAD_IND)";
+        case Op::LOAD_ACQ: return "Stack underflow (LOAD_ACQ)";
+        case Op::LOAD_IDX: return "Stack underflow (LOAD_IDX)";
+        case Op::STORE_REL: return "Stack underflow (STORE_REL)";
+        case Op::STORE_IDX: return "Stack underflow (STORE_IDX)";
+        case Op::JZ: case Op::JNZ: return "Stack underflow (JZ/JNZ)";
+        case Op::JEQ: case Op::JNE: case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+            return "Stack underflow (Jcc)";
+        case Op::JEQ_IMM: case Op::JNE_IMM: case Op::JLT_IMM: case Op::JLE_IMM: case Op::JGT_IMM: case Op::JGE_IMM:
+            return "Stack underflow (Jcc_IMM)";
+        default: return "Stack underflow (arith)";
+    }
+}
+
+} // namespace
+
+BatchVM::BatchVM(u32 lanes, u32 stackCells)
+    : m_lanes(lanes), m_stackCells(stackCells), m_mem(MEM_SIZE, 0),
+      m_stack(static_cast<std::size_t>(lanes) * stackCells, 0), m_ip(lanes), m_sp(lanes),
+      m_state(lanes), m_error(lanes), m_mask(lanes) {
+    reset();
+}
+
+void BatchVM::load(const std::vector<u32>& codeCells) {
+    std::fill(m_mem.begin(), m_mem.end(), 0);
+    for (u32 i = 0; i < codeCells.size() && (VM::CODE_BASE + i) < MEM_SIZE; ++i) {
+        m_mem[VM::CODE_BASE + i] = static_cast<i32>(codeCells[i]);
+    }
+    reset();
+}
+
+void BatchVM::reset() {
+    std::fill(m_ip.begin(), m_ip.end(), VM::CODE_BASE);
+    std::fill(m_sp.begin(), m_sp.end(), 0);
+    std::fill(m_state.begin(), m_state.end(), LANE_RUNNING);
+    std::fill(m_error.begin(), m_error.end(), nullptr);
+    m_groupValid = false;
+}
+
+bool BatchVM::push(u32 lane, i32 value) {
+    if (lane >= m_lanes || m_sp[lane] >= m_stackCells) return false;
+    row(m_sp[lane]++)[lane] = value;
+    m_groupValid = false;
+    return true;
+}
+
+BatchResult BatchVM::run(std::size_t maxSteps) {
+    BatchResult r{};
+    while (r.steps < maxSteps && (m_groupValid || selectGroup())) {
+        r.laneSteps += m_groupSize;
+        ++r.steps;
+        execGroup();
+    }
+    for (u8 s : m_state) {
+        if (s == LANE_HALTED) ++r.halted;
+        else if (s == LANE_FAULTED) ++r.faulted;
+        else ++r.running;
+    }
+    return r;
+}
+
+bool BatchVM::selectGroup() {
+    u32 first = m_lanes;
+    u32 minIp = ~u32{0};
+    for (u32 l = 0; l < m_lanes; ++l) {
+        if (m_state[l] == LANE_RUNNING && m_ip[l] < minIp) {
+            minIp = m_ip[l];
+            first = l;
+        }
+    }
+    if (first == m_lanes) return false;
+
+    // Lanes before `first` are all past it or finished.
+    m_groupIp = minIp;
+    m_groupSp = m_sp[first];
+    m_groupLo = m_groupHi = first;
+    m_groupSize = 0;
+    m_otherMin = ~u32{0};
+    for (u32 l = first; l < m_lanes; ++l) {
+        const bool running = m_state[l] == LANE_RUNNING;
+        const bool in = running && m_ip[l] == minIp && m_sp[l] == m_groupSp;
+        m_mask[l] = in;
+        if (in) {
+            m_groupHi = l;
+            ++m_groupSize;
+        } else if (running) {
+            m_otherMin = std::min(m_otherMin, m_ip[l]);
+        }
+    }
+    for (u32 l = 0; l < first; ++l) {
+        if (m_state[l] == LANE_RUNNING) m_otherMin = std::min(m_otherMin, m_ip[l]);
+    }
+    m_groupValid = true;
+    return true;
+}
+
+void BatchVM::retire(u32 nextIp, u32 depth) {
+    for (u32 l = m_groupLo; l <= m_groupHi; ++l) {
+        if (m_mask[l]) {
+            m_ip[l] = nextIp;
+            m_sp[l] = depth;
+        }
+    }
+    // The group stays together until it reaches (or passes) another lane.
+    m_groupIp = nextIp;
+    m_groupSp = depth;
+    m_groupValid = m_groupSize != 0 && nextIp < m_otherMin;
+}
+
+void BatchVM::fault(u32 lane, const char* error) {
+    m_state[lane] = LANE_FAULTED;
+    m_error[lane] = error;
+    m_mask[lane] = 0;
+    --m_groupSize;
+    // Keep lo/hi on masked lanes: STORE takes the value of the last one.
+    if (m_groupSize == 0) return;
+    while (!m_mask[m_groupHi]) --m_groupHi;
+    while (!m_mask[m_groupLo]) ++m_groupLo;
+}
+
+void BatchVM::faultGroup(const char* error) {
+    const u32 lo = m_groupLo, hi = m_groupHi;
+    for (u32 l = lo; l <= hi; ++l) {
+        if (m_mask[l]) fault(l, error);
+    }
+    m_groupValid = false;
+}
+
+// Element-wise ops compute every lane in the group's range and keep the
+// result only where masked, so the loops have no branches.
+template <typename F> void BatchVM::unary(u32 depth, F f) {
+    i32* t = row(depth - 1);
+    for (u32 l = m_groupLo; l <= m_groupHi; ++l) {
+        const i32 v = f(t[l]);
+        t[l] = m_mask[l] ? v : t[l];
+    }
+}
+
+template <typename F> void BatchVM::binary(u32 depth, F f) {
+    i32* a = row(depth - 2);
+    const i32* b = row(depth - 1);
+    for (u32 l = m_groupLo; l <= m_groupHi; ++l) {
+        const i32 v = f(a[l], b[l]);
+        a[l] = m_mask[l] ? v : a[l];
+    }
+}
+
+void BatchVM::execGroup() {
+    const u32 ip = m_groupIp;
+    const u32 d = m_groupSp;
+    const u32 lo = m_groupLo;
+    const u32 hi = m_groupHi;
+    if (ip >= MEM_SIZE) { faultGroup("IP out of range"); return; }
+    const Op op = static_cast<Op>(static_cast<u32>(m_mem[ip]));
+    auto operand = [&](u32 k, u32& out) {
+        if (ip + 1 + k >= MEM_SIZE) return false;
+        out = static_cast<u32>(m_mem[ip + 1 + k]);
+        return true;
+    };
+
+    switch (op) {
+        case Op::HALT:
+            for (u32 l = lo; l <= hi; ++l) {
+                if (m_mask[l]) m_state[l] = LANE_HALTED;
+            }
+            m_groupValid = false;
+            return;
+        case Op::PUSHI: {
+            u32 imm;
+            if (!operand(0, imm)) { faultGroup("Truncated PUSHI"); return; }
+            if (d >= m_stackCells) { faultGroup("Stack overflow"); return; }
+            i32* t = row(d);
+            for (u32 l = lo; l <= hi; ++l) t[l] = m_mask[l] ? static_cast<i32>(imm) : t[l];
+            retire(ip + 2, d + 1);
+            return;
+        }
+        case Op::POP:
+            if (d < 1) { faultGroup("Stack underflow (POP)"); return; }
+            retire(ip + 1, d - 1);
+            return;
+        case Op::DUP:
+        case Op::OVER: {
+            const u32 from = op == Op::DUP ? 1 : 2;
+            if (d < from) { faultGroup(op == Op::DUP ? "Stack underflow (DUP)" : "Stack underflow (OVER)"); return; }
+            if (d >= m_stackCells) { faultGroup(op == Op::DUP ? "Stack overflow (DUP)" : "Stack overflow (OVER)"); return; }
+            i32* t = row(d);
+            const i32* s = row(d - from);
+            for (u32 l = lo; l <= hi; ++l) t[l] = m_mask[l] ? s[l] : t[l];
+            retire(ip + 1, d + 1);
+            return;
+        }
+        case Op::SWAP: {
+            if (d < 2) { faultGroup("Stack underflow (SWAP)"); return; }
+            i32* a = row(d - 2);
+            i32* b = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                const i32 x = a[l], y = b[l];
+                a[l] = m_mask[l] ? y : x;
+                b[l] = m_mask[l] ? x : y;
+            }
+            retire(ip + 1, d);
+            return;
+        }
+        case Op::NEG:
+        case Op::NOT:
+        case Op::FNEG:
+        case Op::FSQRT:
+        case Op::ITOF:
+        case Op::FTOI: {
+            if (d < 1) { faultGroup(underflow(op)); return; }
+            switch (op) {
+                case Op::NEG:   unary(d, [](i32 a) { return wrap(0u - static_cast<u32>(a)); }); break;
+                case Op::NOT:   unary(d, [](i32 a) { return ~a; }); break;
+                case Op::FNEG:  unary(d, [](i32 a) { return a ^ static_cast<i32>(0x80000000u); }); break;
+                case Op::FSQRT: unary(d, [](i32 a) { return f32ToCell(std::sqrt(cellToF32(a))); }); break;
+                case Op::ITOF:  unary(d, [](i32 a) { return f32ToCell(static_cast<float>(a)); }); break;
+                default:        unary(d, ftoi); break;
+            }
+            retire(ip + 1, d);
+            return;
+        }
+        case Op::ADD: case Op::SUB: case Op::MUL:
+        case Op::AND: case Op::OR: case Op::XOR:
+        case Op::SHL: case Op::SHR: case Op::SAR:
+        case Op::CMP_EQ: case Op::CMP_LT: case Op::CMP_GT: case Op::CMP_LTU:
+        case Op::FADD: case Op::FSUB: case Op::FMUL: case Op::FDIV: case Op::FCMP:
+        case Op::FXMUL:
+        case Op::VADD8: case Op::VADDS8: case Op::VSUBS8: case Op::VMUL8:
+        case Op::VMIN8: case Op::VMAX8: case Op::VAVG8:
+        case Op::VADD16: case Op::VADDS16: case Op::VSUBS16: case Op::VMUL16:
+        case Op::VMIN16: case Op::VMAX16: case Op::VAVG16: {
+            if (d < 2) { faultGroup(underflow(op)); return; }
+            using U = u32;
+            switch (op) {
+                case Op::ADD: binary(d, [](i32 a, i32 b) { return wrap(U(a) + U(b)); }); break;
+                case Op::SUB: binary(d, [](i32 a, i32 b) { return wrap(U(a) - U(b)); }); break;
+                case Op::MUL: binary(d, [](i32 a, i32 b) { return wrap(U(a) * U(b)); }); break;
+                case Op::AND: binary(d, [](i32 a, i32 b) { return a & b; }); break;
+                case Op::OR:  binary(d, [](i32 a, i32 b) { return a | b; }); break;
+                case Op::XOR: binary(d, [](i32 a, i32 b) { return a ^ b; }); break;
+                case Op::SHL: binary(d, [](i32 a, i32 b) { return wrap(U(a) << (U(b) & 31u)); }); break;
+                case Op::SHR: binary(d, [](i32 a, i32 b) { return wrap(U(a) >> (U(b) & 31u)); }); break;
+                case Op::SAR: binary(d, [](i32 a, i32 b) { return a >> (U(b) & 31u); }); break;
+                case Op::CMP_EQ:  binary(d, [](i32 a, i32 b) { return i32(a == b); }); break;
+                case Op::CMP_LT:  binary(d, [](i32 a, i32 b) { return i32(a < b); }); break;
+                case Op::CMP_GT:  binary(d, [](i32 a, i32 b) { return i32(a > b); }); break;
+                case Op::CMP_LTU: binary(d, [](i32 a, i32 b) { return i32(U(a) < U(b)); }); break;
+                case Op::FADD: binary(d, [](i32 a, i32 b) { return f32ToCell(cellToF32(a) + cellToF32(b)); }); break;
+                case Op::FSUB: binary(d, [](i32 a, i32 b) { return f32ToCell(cellToF32(a) - cellToF32(b)); }); break;
+                case Op::FMUL: binary(d, [](i32 a, i32 b) { return f32ToCell(cellToF32(a) * cellToF32(b)); }); break;
+                case Op::FDIV: binary(d, [](i32 a, i32 b) { return f32ToCell(cellToF32(a) / cellToF32(b)); }); break;
+                case Op::FCMP: binary(d, [](i32 a, i32 b) {
+                    const float fa = cellToF32(a), fb = cellToF32(b);
+                    return (fa < fb) ? -1 : (fa > fb) ? 1 : (fa == fb) ? 0 : 2;
+                }); break;
+                case Op::FXMUL: binary(d, [](i32 a, i32 b) {
+                    return wrap(static_cast<U>((std::int64_t{a} * b) >> 16));
+                }); break;
+                case Op::VADD8:   binary(d, [](i32 a, i32 b) { return wrap(lanes::add<8>(U(a), U(b))); }); break;
+                case Op::VADDS8:  binary(d, [](i32 a, i32 b) { return wrap(lanes::addSat<8>(U(a), U(b))); }); break;
+                case Op::VSUBS8:  binary(d, [](i32 a, i32 b) { return wrap(lanes::subSat<8>(U(a), U(b))); }); break;
+                case Op::VMUL8:   binary(d, [](i32 a, i32 b) { return wrap(lanes::mul8(U(a), U(b))); }); break;
+                case Op::VMIN8:   binary(d, [](i32 a, i32 b) { return wrap(lanes::min<8>(U(a), U(b))); }); break;
+                case Op::VMAX8:   binary(d, [](i32 a, i32 b) { return wrap(lanes::max<8>(U(a), U(b))); }); break;
+                case Op::VAVG8:   binary(d, [](i32 a, i32 b) { return wrap(lanes::avg<8>(U(a), U(b))); }); break;
+                case Op::VADD16:  binary(d, [](i32 a, i32 b) { return wrap(lanes::add<16>(U(a), U(b))); }); break;
+                case Op::VADDS16: binary(d, [](i32 a, i32 b) { return wrap(lanes::addSat<16>(U(a), U(b))); }); break;
+                case Op::VSUBS16: binary(d, [](i32 a, i32 b) { return wrap(lanes::subSat<16>(U(a), U(b))); }); break;
+                case Op::VMUL16:  binary(d, [](i32 a, i32 b) { return wrap(lanes::mul16(U(a), U(b))); }); break;
+                case Op::VMIN16:  binary(d, [](i32 a, i32 b) { return wrap(lanes::min<16>(U(a), U(b))); }); break;
+                case Op::VMAX16:  binary(d, [](i32 a, i32 b) { return wrap(lanes::max<16>(U(a), U(b))); }); break;
+                default:          binary(d, [](i32 a, i32 b) { return wrap(lanes::avg<16>(U(a), U(b))); }); break;
+            }
+            retire(ip + 1, d - 1);
+            return;
+        }
+        case Op::DIV: case Op::MOD: case Op::DIVU: case Op::MODU: case Op::FXDIV: {
+            // Per lane: a zero divisor faults only that lane.
+            if (d < 2) { faultGroup(underflow(op)); return; }
+            i32* a = row(d - 2);
+            const i32* b = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                if (!m_mask[l]) continue;
+                if (b[l] == 0) { fault(l, op == Op::MOD || op == Op::MODU ? "Modulo by zero" : "Division by zero"); continue; }
+                const u32 ua = static_cast<u32>(a[l]), ub = static_cast<u32>(b[l]);
+                switch (op) {
+                    case Op::DIV:  a[l] = b[l] == -1 ? wrap(0u - ua) : a[l] / b[l]; break; // INT32_MIN / -1 wraps
+                    case Op::MOD:  a[l] = b[l] == -1 ? 0 : a[l] % b[l]; break;
+                    case Op::DIVU: a[l] = wrap(ua / ub); break;
+                    case Op::MODU: a[l] = wrap(ua % ub); break;
+                    default:       a[l] = wrap(static_cast<u32>((std::int64_t{a[l]} * 65536) / b[l])); break;
+                }
+            }
+            retire(ip + 1, d - 1);
+            return;
+        }
+        case Op::LERP8X4: {
+            if (d < 3) { faultGroup("Stack underflow (LERP8X4)"); return; }
+            i32* a = row(d - 3);
+            const i32* b = row(d - 2);
+            const i32* t = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                const u32 wb = static_cast<u32>(std::min(std::max(t[l], 0), 256));
+                const i32 v = wrap(lanes::lerp8x4(static_cast<u32>(a[l]), static_cast<u32>(b[l]), wb));
+                a[l] = m_mask[l] ? v : a[l];
+            }
+            retire(ip + 1, d - 2);
+            return;
+        }
+        case Op::LOAD: {
+            u32 addr;
+            if (!operand(0, addr)) { faultGroup("Truncated LOAD"); return; }
+            if (addr >= MEM_SIZE) { faultGroup("LOAD out of range"); return; }
+            if (d >= m_stackCells) { faultGroup("Stack overflow (LOAD)"); return; }
+            const i32 v = m_mem[addr];
+            i32* t = row(d);
+            for (u32 l = lo; l <= hi; ++l) t[l] = m_mask[l] ? v : t[l];
+            retire(ip + 2, d + 1);
+            return;
+        }
+        case Op::STORE: {
+            u32 addr;
+            if (!operand(0, addr)) { faultGroup("Truncated STORE"); return; }
+            if (addr >= MEM_SIZE) { faultGroup("STORE out of range"); return; }
+            if (d < 1) { faultGroup("Stack underflow (STORE)"); return; }
+            m_mem[addr] = row(d - 1)[hi]; // the last lane's store wins
+            retire(ip + 2, d - 1);
+            return;
+        }
+        case Op::LOAD_IND:
+        case Op::LOAD_ACQ:
+        case Op::LOAD_IDX: {
+            u32 base = 0;
+            const bool idx = op == Op::LOAD_IDX;
+            const char* range = idx ? "LOAD_IDX out of range" : op == Op::LOAD_ACQ ? "LOAD_ACQ out of range" : "LOAD_IND out of range";
+            if (idx && !operand(0, base)) { faultGroup("Truncated LOAD_IDX"); return; }
+            if (d < 1) { faultGroup(underflow(op)); return; }
+            i32* t = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                if (!m_mask[l]) continue;
+                const u32 addr = base + static_cast<u32>(t[l]);
+                if (addr >= MEM_SIZE) { fault(l, range); continue; }
+                t[l] = m_mem[addr];
+            }
+            retire(ip + (idx ? 2 : 1), d);
+            return;
+        }
+        case Op::STORE_IND:
+        case Op::STORE_REL:
+        case Op::STORE_IDX: {
+            u32 base = 0;
+            const bool idx = op == Op::STORE_IDX;
+            const char* range = idx ? "STORE_IDX out of range" : op == Op::STORE_REL ? "STORE_REL out of range" : "STORE_IND out of range";
+            if (idx && !operand(0, base)) { faultGroup("Truncated STORE_IDX"); return; }
+            if (d < 2) {
+                if (op == Op::STORE_IND) faultGroup(d == 0 ? "Stack underflow (STORE_IND addr)" : "Stack underflow (STORE_IND value)");
+                else faultGroup(underflow(op));
+                return;
+            }
+            const i32* v = row(d - 2);
+            const i32* t = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                if (!m_mask[l]) continue;
+                const u32 addr = base + static_cast<u32>(t[l]);
+                if (addr >= MEM_SIZE) { fault(l, range); continue; }
+                m_mem[addr] = v[l];
+            }
+            retire(ip + (idx ? 2 : 1), d - 2);
+            return;
+        }
+        case Op::CAS: {
+            if (d < 3) { faultGroup("Stack underflow (CAS)"); return; }
+            i32* desired = row(d - 3);
+            const i32* expected = row(d - 2);
+            const i32* addrs = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                if (!m_mask[l]) continue;
+                const u32 addr = static_cast<u32>(addrs[l]);
+                if (addr >= MEM_SIZE) { fault(l, "CAS out of range"); continue; }
+                const i32 old = m_mem[addr];
+                if (old == expected[l]) m_mem[addr] = desired[l];
+                desired[l] = old;
+            }
+            retire(ip + 1, d - 2);
+            return;
+        }
+        case Op::XADD: {
+            if (d < 2) { faultGroup("Stack underflow (XADD)"); return; }
+            i32* delta = row(d - 2);
+            const i32* addrs = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                if (!m_mask[l]) continue;
+                const u32 addr = static_cast<u32>(addrs[l]);
+                if (addr >= MEM_SIZE) { fault(l, "XADD out of range"); continue; }
+                const i32 old = m_mem[addr];
+                m_mem[addr] = wrap(static_cast<u32>(old) + static_cast<u32>(delta[l]));
+                delta[l] = old;
+            }
+            retire(ip + 1, d - 1);
+            return;
+        }
+        case Op::FB_XY: {
+            if (d < 2) { faultGroup("Stack underflow (FB_XY)"); return; }
+            i32* x = row(d - 2);
+            const i32* y = row(d - 1);
+            for (u32 l = lo; l <= hi; ++l) {
+                if (!m_mask[l]) continue;
+                const u32 ux = static_cast<u32>(x[l]), uy = static_cast<u32>(y[l]);
+                if (ux >= VM::FB_WIDTH || uy >= VM::FB_HEIGHT) { fault(l, "FB_XY out of range"); continue; }
+                x[l] = static_cast<i32>(VM::FB_BASE + uy * VM::FB_WIDTH + ux);
+            }
+            retire(ip + 1, d - 1);
+            return;
+        }
+        case Op::JMP: {
+            u32 addr;
+            if (!operand(0, addr)) { faultGroup("Truncated JMP"); return; }
+            if (addr >= MEM_SIZE) { faultGroup("JMP out of range"); return; }
+            retire(addr, d);
+            return;
+        }
+        case Op::JZ: case Op::JNZ:
+        case Op::JEQ: case Op::JNE: case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+        case Op::JEQ_IMM: case Op::JNE_IMM: case Op::JLT_IMM: case Op::JLE_IMM: case Op::JGT_IMM: case Op::JGE_IMM: {
+            // Each lane takes its own way; the group splits here.
+            const bool cond = op == Op::JZ || op == Op::JNZ;
+            const bool imm = op >= Op::JEQ_IMM && op <= Op::JGE_IMM;
+            const u32 pops = cond || imm ? 1 : 2;
+            u32 addr, immCell = 0;
+            if ((imm && !operand(0, immCell)) || !operand(imm ? 1 : 0, addr)) {
+                faultGroup(cond ? "Truncated JZ/JNZ" : imm ? "Truncated Jcc_IMM" : "Truncated Jcc");
+                return;
+            }
+            if (d < pops) { faultGroup(underflow(op)); return; }
+            const u32 next = ip + (imm ? 3 : 2);
+            const i32* a = row(d - pops);
+            const i32* b = pops == 2 ? row(d - 1) : nullptr;
+            u32 takenCount = 0;
+            for (u32 l = lo; l <= hi; ++l) {
+                if (!m_mask[l]) continue;
+                bool taken;
+                if (op == Op::JZ) taken = a[l] == 0;
+                else if (op == Op::JNZ) taken = a[l] != 0;
+                else taken = branchTaken(op, a[l], imm ? static_cast<i32>(immCell) : b[l]);
+                if (taken && addr >= MEM_SIZE) { fault(l, "Jump out of range"); continue; }
+                m_ip[l] = taken ? addr : next;
+                m_sp[l] = d - pops;
+                takenCount += taken;
+            }
+            // A uniform branch keeps the group together.
+            if (takenCount == 0 || takenCount == m_groupSize) retire(takenCount ? addr : next, d - pops);
+            else m_groupValid = false;
+            return;
+        }
+        case Op::PRINT:
+        case Op::SYSCALL:
+        case Op::HALT_UNTIL_IRQ:
+        case Op::RETI:
+        case Op::SPAWN:
+        case Op::YIELD:
+        case Op::JOIN:
+        case Op::ALLOC:
+        case Op::FREE:
+        case Op::REALLOC:
+            faultGroup("Opcode not available in batch mode");
+            return;
+        default:
+            faultGroup("Invalid opcode");
+            return;
+    }
+}
+
+} // namespace vm32
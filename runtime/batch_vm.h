@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "vm.h"
+
+namespace vm32 {
+
+// Instruction counts for one BatchVM::run().
+struct BatchResult {
+    std::size_t steps{0};     // instructions issued (once per lane group)
+    std::size_t laneSteps{0}; // instructions executed, summed over lanes
+    u32 halted{0};            // lanes that reached HALT
+    u32 faulted{0};           // lanes stopped by an error (see BatchVM::laneError())
+    u32 running{0};           // lanes still running when maxSteps ran out
+};
+
+// Runs one program for many lanes in lockstep (SIMT). Each lane has its own
+// ip and stack; memory is shared. Stacks are stored structure-of-arrays, one
+// row of `lanes` cells per depth, so an instruction executes as a loop across
+// the lanes it applies to. Each step issues the instruction at the lowest ip
+// of any running lane, for every lane at that ip and stack depth (the
+// execution mask); lanes that branch apart run separately until their ips
+// meet again.
+//
+// Memory is a plain MEM_SIZE array with the VM's layout but no devices.
+// Stores from several lanes of one instruction land in lane order, so the
+// highest lane wins; CAS and XADD apply lane by lane. PRINT, SYSCALL,
+// interrupts, green threads and the heap are not available and fault the lane.
+class BatchVM {
+public:
+    explicit BatchVM(u32 lanes, u32 stackCells = 64);
+
+    void load(const std::vector<u32>& codeCells); // clears memory and all lanes
+    void reset();                                 // lanes back to CODE_BASE with empty stacks
+
+    i32* memData() { return m_mem.data(); } // VM::MEM_SIZE cells
+    const i32* memData() const { return m_mem.data(); }
+
+    // Push a lane's inputs before run(); returns false when its stack is full.
+    bool push(u32 lane, i32 value);
+
+    BatchResult run(std::size_t maxSteps = 1'000'000);
+
+    u32 lanes() const { return m_lanes; }
+    bool laneHalted(u32 lane) const { return m_state[lane] == LANE_HALTED; }
+    const char* laneError(u32 lane) const { return m_error[lane]; } // nullptr unless faulted
+    u32 laneIp(u32 lane) const { return m_ip[lane]; }               // the faulting instruction when faulted
+    u32 laneDepth(u32 lane) const { return m_sp[lane]; }
+    i32 laneAt(u32 lane, u32 depth) const { return m_stack[depth * m_lanes + lane]; } // depth 0 = bottom
+
+private:
+    static constexpr u8 LANE_RUNNING = 0;
+    static constexpr u8 LANE_HALTED  = 1;
+    static constexpr u8 LANE_FAULTED = 2;
+
+    bool selectGroup();  // build the mask for the next issue; false when no lane is running
+    void execGroup();    // one instruction for the masked lanes
+    i32* row(u32 depth) { return &m_stack[depth * m_lanes]; }
+    void retire(u32 nextIp, u32 depth); // masked lanes move on together
+    void fault(u32 lane, const char* error);
+    void faultGroup(const char* error);
+
+    template <typename F> void unary(u32 depth, F f);
+    template <typename F> void binary(u32 depth, F f);
+
+    u32 m_lanes;
+    u32 m_stackCells;
+    std::vector<i32> m_mem;
+    std::vector<i32> m_stack;  // m_stackCells rows of m_lanes cells
+    std::vector<u32> m_ip;
+    std::vector<u32> m_sp;     // stack depth
+    std::vector<u8> m_state;
+    std::vector<const char*> m_error;
+
+    std::vector<u8> m_mask;    // lanes of the current group
+    u32 m_groupIp{0};
+    u32 m_groupSp{0};
+    u32 m_groupLo{0};          // first and last masked lane
+    u32 m_groupHi{0};
+    u32 m_groupSize{0};
+    u32 m_otherMin{0};         // lowest ip of the running lanes outside the group
+    bool m_groupValid{false};  // the group can issue again without a rescan
+};
+
+} // namespace vm32
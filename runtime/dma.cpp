@@ -0,0 +1,49 @@
+#include "dma.h"
+
+#include <cstring>
+
+namespace vm32 {
+
+DmaChannel::~DmaChannel() {
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_cv.wait(lock, [&] { return !m_busy; });
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_worker.joinable()) m_worker.join();
+}
+
+void DmaChannel::start(Transfer t) {
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_cv.wait(lock, [&] { return !m_busy; });
+        m_job = std::move(t);
+        m_busy = true;
+        if (!m_worker.joinable()) m_worker = std::thread(&DmaChannel::work, this);
+    }
+    m_cv.notify_all();
+}
+
+void DmaChannel::wait() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_cv.wait(lock, [&] { return !m_busy; });
+}
+
+void DmaChannel::work() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;) {
+        m_cv.wait(lock, [&] { return m_busy || m_stop; });
+        if (!m_busy) return;
+        Transfer job = std::move(m_job);
+        lock.unlock();
+        std::memmove(job.dst, job.src, job.cells * sizeof(i32));
+        if (job.done) job.done();
+        job = Transfer{}; // drop the blob before reporting idle
+        lock.lock();
+        m_busy = false;
+        m_cv.notify_all();
+    }
+}
+
+} // namespace vm32
@@ -0,0 +1,47 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// Host worker thread behind the DMA registers (see VM::DMA_CTRL_ADDR). It runs
+// one transfer at a time: start() hands a copy to the worker, which moves the
+// cells and then calls the transfer's completion function on the worker
+// thread. The thread starts with the first transfer.
+class DmaChannel {
+public:
+    struct Transfer {
+        i32* dst{nullptr};
+        const i32* src{nullptr};
+        std::size_t cells{0};
+        std::shared_ptr<const std::vector<i32>> blob; // keeps a host blob source alive
+        std::function<void()> done;
+    };
+
+    DmaChannel() = default;
+    ~DmaChannel(); // completes the transfer in flight
+    DmaChannel(const DmaChannel&) = delete;
+    DmaChannel& operator=(const DmaChannel&) = delete;
+
+    void start(Transfer t); // waits for the transfer in flight first
+    void wait();            // until no transfer is in flight
+
+private:
+    void work();
+
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::thread m_worker;
+    Transfer m_job;
+    bool m_busy{false}; // m_job handed over and not yet completed
+    bool m_stop{false};
+};
+
+} // namespace vm32
@@ -0,0 +1,48 @@
+#include "event_script.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace vm32 {
+
+bool loadEventScript(const std::string& path, std::vector<ScriptedEvent>& outEvents, std::string* outError) {
+    std::ifstream f(path);
+    if (!f) {
+        if (outError) *outError = "Failed to open event script: " + path;
+        return false;
+    }
+
+    outEvents.clear();
+    std::string line;
+    for (std::size_t lineNo = 1; std::getline(f, line); ++lineNo) {
+        const std::size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+
+        std::istringstream ls(line);
+        std::string kind;
+        ScriptedEvent ev;
+        if (!(ls >> ev.timeMs)) continue; // blank line
+        if (!(ls >> kind >> ev.scancode) || (kind != "down" && kind != "up")) {
+            if (outError) *outError = path + ":" + std::to_string(lineNo) + ": expected '<time_ms> down|up <scancode>'";
+            return false;
+        }
+        if (!outEvents.empty() && ev.timeMs < outEvents.back().timeMs) {
+            if (outError) *outError = path + ":" + std::to_string(lineNo) + ": events must be in time order";
+            return false;
+        }
+        ev.type = (kind == "down") ? VM::EV_KEY_DOWN : VM::EV_KEY_UP;
+        outEvents.push_back(ev);
+    }
+    return true;
+}
+
+void EventFeeder::feed(VM& vm, u32 nowMs, std::vector<ScriptedEvent>* pushed) {
+    while (m_next < m_events.size() && m_events[m_next].timeMs <= nowMs) {
+        const ScriptedEvent& ev = m_events[m_next];
+        if (!vm.pushInputEvent(ev.type, ev.scancode, ev.timeMs)) return;
+        if (pushed) pushed->push_back(ev);
+        ++m_next;
+    }
+}
+
+} // namespace vm32
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "vm.h"
+
+namespace vm32 {
+
+struct ScriptedEvent {
+    u32 timeMs{0};
+    u32 type{VM::EV_KEY_DOWN};
+    u32 scancode{0};
+};
+
+// Text format, one event per line, sorted by time ('#' starts a comment):
+//   <time_ms> down|up <sdl_scancode>
+bool loadEventScript(const std::string& path, std::vector<ScriptedEvent>& outEvents, std::string* outError = nullptr);
+
+// Feeds scripted events into a VM's input queue as virtual time advances.
+class EventFeeder {
+public:
+    explicit EventFeeder(std::vector<ScriptedEvent> events) : m_events(std::move(events)) {}
+
+    // Push every event due at or before nowMs. An event that does not fit in a
+    // full queue is retried on the next call, so nothing is lost. Events that
+    // were pushed are appended to `pushed` when given.
+    void feed(VM& vm, u32 nowMs, std::vector<ScriptedEvent>* pushed = nullptr);
+    bool done() const { return m_next >= m_events.size(); }
+
+private:
+    std::vector<ScriptedEvent> m_events;
+    std::size_t m_next{0};
+};
+
+} // namespace vm32
@@ -0,0 +1,69 @@
+#include "gas.h"
+
+#include "../bytecode/basic_blocks.h"
+#include "../bytecode/opcode_info.h"
+
+namespace vm32 {
+
+GasClass gasClassOf(Op op) {
+    switch (op) {
+        case Op::LOAD: case Op::STORE: case Op::STORE_IND: case Op::LOAD_IND:
+        case Op::LOAD_IDX: case Op::STORE_IDX:
+        case Op::LOAD_ACQ: case Op::STORE_REL: case Op::CAS: case Op::XADD:
+        case Op::ALLOC: case Op::FREE: case Op::REALLOC:
+            return GasClass::Memory;
+        case Op::MUL: case Op::DIV: case Op::MOD: case Op::DIVU: case Op::MODU:
+        case Op::FXMUL: case Op::FXDIV:
+            return GasClass::MulDiv;
+        case Op::FADD: case Op::FSUB: case Op::FMUL: case Op::FDIV: case Op::FNEG:
+        case Op::FSQRT: case Op::ITOF: case Op::FTOI: case Op::FCMP:
+            return GasClass::Float;
+        case Op::LERP8X4:
+        case Op::VADD8: case Op::VADDS8: case Op::VSUBS8: case Op::VMUL8:
+        case Op::VMIN8: case Op::VMAX8: case Op::VAVG8:
+        case Op::VADD16: case Op::VADDS16: case Op::VSUBS16: case Op::VMUL16:
+        case Op::VMIN16: case Op::VMAX16: case Op::VAVG16:
+            return GasClass::Packed;
+        case Op::JMP: case Op::JZ: case Op::JNZ:
+        case Op::JEQ: case Op::JNE: case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+        case Op::JEQ_IMM: case Op::JNE_IMM: case Op::JLT_IMM: case Op::JLE_IMM: case Op::JGT_IMM: case Op::JGE_IMM:
+        case Op::RETI: case Op::SPAWN: case Op::YIELD: case Op::JOIN:
+            return GasClass::Branch;
+        case Op::PRINT:
+            return GasClass::Output;
+        case Op::SYSCALL:
+            return GasClass::Syscall;
+        default:
+            return GasClass::Basic;
+    }
+}
+
+std::vector<u32> buildGasTable(const u32* code, std::size_t count, const GasSchedule& schedule) {
+    std::vector<u32> table(count, GAS_UNMETERED);
+    const std::vector<BasicBlock> blocks = findBasicBlocks(code, count);
+
+    // Walk backwards so a fall-through block can add its successor's entry cost.
+    u32 carry = 0; // entry cost of the block after the current one, if reached by falling through
+    for (auto b = blocks.rbegin(); b != blocks.rend(); ++b) {
+        OpInfo lastInfo;
+        opInfo(code[b->last], lastInfo);
+        std::uint64_t suffix = (lastInfo.flags & (OPF_BRANCH | OPF_STOP | OPF_SWITCH)) ? 0 : carry;
+
+        // Instruction starts of this block, then accumulate from the back.
+        std::vector<u32> starts;
+        for (u32 pc = b->start; pc < b->end;) {
+            OpInfo info;
+            opInfo(code[pc], info);
+            starts.push_back(pc);
+            pc += 1 + info.operands;
+        }
+        for (auto pc = starts.rbegin(); pc != starts.rend(); ++pc) {
+            suffix += schedule[gasClassOf(static_cast<Op>(code[*pc]))];
+            table[*pc] = suffix < GAS_UNMETERED ? static_cast<u32>(suffix) : GAS_UNMETERED - 1;
+        }
+        carry = table[b->start];
+    }
+    return table;
+}
+
+} // namespace vm32
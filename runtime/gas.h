@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// Opcode classes with separately configurable gas costs.
+enum class GasClass : u8 {
+    Basic,   // stack shuffling, integer add/sub/compare, bitwise
+    Memory,  // LOAD/STORE and indexed forms
+    MulDiv,  // integer and fixed-point multiply/divide
+    Float,   // FADD..FCMP
+    Packed,  // SWAR lane ops, LERP8X4
+    Branch,  // jumps, RETI, thread ops
+    Output,  // PRINT
+    Syscall, // SYSCALL (plus whatever the host function does)
+    Count
+};
+
+struct GasSchedule {
+    std::array<u32, static_cast<std::size_t>(GasClass::Count)> cost{ { 1, 2, 4, 4, 2, 2, 8, 16 } };
+
+    u32& operator[](GasClass c) { return cost[static_cast<std::size_t>(c)]; }
+    u32 operator[](GasClass c) const { return cost[static_cast<std::size_t>(c)]; }
+};
+
+GasClass gasClassOf(Op op);
+
+// Cells that cannot be entered while metering (data, mid-instruction).
+constexpr u32 GAS_UNMETERED = 0xFFFFFFFFu;
+
+// Entry cost per code cell: the gas for running from that instruction to the
+// end of its straight-line run, i.e. through fall-through blocks up to and
+// including the next branch, stop or thread switch. Saturates below GAS_UNMETERED.
+std::vector<u32> buildGasTable(const u32* code, std::size_t count, const GasSchedule& schedule);
+
+} // namespace vm32
@@ -0,0 +1,126 @@
+#include "heap.h"
+
+#include <algorithm>
+
+namespace vm32 {
+
+namespace {
+
+// Block header: tag, free flag and size class.
+constexpr u32 HEADER_TAG  = 0x48450000u;
+constexpr u32 HEADER_FREE = 0x100u;
+constexpr u32 CLASS_MASK  = 0xFFu;
+
+const char* const kCorrupt = "Heap corrupted";
+
+i32 header(u32 c, bool isFree) { return static_cast<i32>(HEADER_TAG | (isFree ? HEADER_FREE : 0u) | c); }
+
+} // namespace
+
+float HeapStats::fragmentation() const {
+    const u32 total = freeCells + bumpCells;
+    if (total == 0) return 0.0f;
+    const u32 largest = std::max(largestFree, bumpCells > 0 ? bumpCells - 1 : 0u); // bump blocks need a header
+    return 1.0f - static_cast<float>(largest) / static_cast<float>(total);
+}
+
+u32 Heap::classOf(u32 n) {
+    if (n <= 3) return n - 1;
+    u32 bits = 0;
+    while (bits < 32 && ((n - 1) >> bits)) ++bits;
+    return (3u << (bits - 2)) >= n ? 2 * bits - 2 : 2 * bits - 1;
+}
+
+void Heap::init(i32* mem) const {
+    mem[m_base] = static_cast<i32>(blocks());
+    std::fill(mem + m_base + 1, mem + m_base + CONTROL_CELLS, 0);
+}
+
+bool Heap::liveBlock(const i32* mem, u32 p) const {
+    if (p <= blocks() || p >= m_end) return false;
+    const u32 c = static_cast<u32>(mem[p - 1]) & CLASS_MASK;
+    return c < CLASSES && mem[p - 1] == header(c, false) && classSize(c) <= m_end - p;
+}
+
+bool Heap::takeFree(i32* mem, u32 c, u32& p) const {
+    p = static_cast<u32>(mem[m_base + 1 + c]);
+    if (p == 0) return true;
+    if (p <= blocks() || p >= m_end || mem[p - 1] != header(c, true)) return false;
+    mem[m_base + 1 + c] = mem[p];
+    mem[p - 1] = header(c, false);
+    return true;
+}
+
+const char* Heap::alloc(i32* mem, u32 n, u32& out) const {
+    out = 0;
+    if (n == 0 || n > classSize(CLASSES - 1) || n > cells()) return nullptr;
+    const u32 c = classOf(n);
+    if (!takeFree(mem, c, out)) return kCorrupt;
+    if (out != 0) return nullptr;
+
+    const u32 top = static_cast<u32>(mem[m_base]);
+    if (top < blocks() || top > m_end) return kCorrupt;
+    const u32 size = classSize(c);
+    if (m_end - top > size) {
+        mem[top] = header(c, false);
+        mem[m_base] = static_cast<i32>(top + 1 + size);
+        out = top + 1;
+        return nullptr;
+    }
+    for (u32 k = c + 1; k < CLASSES && out == 0; ++k) {
+        if (!takeFree(mem, k, out)) return kCorrupt;
+    }
+    return nullptr;
+}
+
+const char* Heap::free(i32* mem, u32 p) const {
+    if (p == 0) return nullptr;
+    if (!liveBlock(mem, p)) return "FREE of invalid pointer";
+    const u32 c = static_cast<u32>(mem[p - 1]) & CLASS_MASK;
+    mem[p] = mem[m_base + 1 + c];
+    mem[m_base + 1 + c] = static_cast<i32>(p);
+    mem[p - 1] = header(c, true);
+    return nullptr;
+}
+
+const char* Heap::realloc(i32* mem, u32 p, u32 n, u32& out) const {
+    if (p == 0) return alloc(mem, n, out);
+    if (!liveBlock(mem, p)) return "REALLOC of invalid pointer";
+    out = 0;
+    if (n == 0) return free(mem, p);
+    const u32 size = classSize(static_cast<u32>(mem[p - 1]) & CLASS_MASK);
+    if (n <= size) {
+        out = p;
+        return nullptr;
+    }
+    if (const char* err = alloc(mem, n, out)) return err;
+    if (out == 0) return nullptr;
+    std::copy(mem + p, mem + p + size, mem + out);
+    return free(mem, p);
+}
+
+const char* Heap::stats(const i32* mem, HeapStats& out) const {
+    out = HeapStats{};
+    out.capacity = m_end - blocks();
+    const u32 top = static_cast<u32>(mem[m_base]);
+    if (top < blocks() || top > m_end) return kCorrupt;
+    for (u32 h = blocks(); h < top;) {
+        const u32 c = static_cast<u32>(mem[h]) & CLASS_MASK;
+        const bool isFree = mem[h] == header(c, true);
+        if (c >= CLASSES || (!isFree && mem[h] != header(c, false)) || classSize(c) > top - h - 1) return kCorrupt;
+        const u32 size = classSize(c);
+        if (isFree) {
+            ++out.freeBlocks;
+            out.freeCells += size;
+            out.largestFree = std::max(out.largestFree, size);
+        } else {
+            ++out.liveBlocks;
+            out.usedCells += size;
+        }
+        h += 1 + size;
+    }
+    out.bumpCells = m_end - top;
+    return nullptr;
+}
+
+} // namespace vm32
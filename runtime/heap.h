@@ -0,0 +1,61 @@
+#pragma once
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// Summary of a heap from walking its blocks (see VM::heapStats()).
+struct HeapStats {
+    u32 capacity{0};    // cells after the control block
+    u32 liveBlocks{0};
+    u32 usedCells{0};   // payload cells of live blocks
+    u32 freeBlocks{0};
+    u32 freeCells{0};   // payload cells on the free lists
+    u32 largestFree{0}; // largest free payload
+    u32 bumpCells{0};   // cells never handed out, above the bump pointer
+
+    // Share of the free space that cannot be had as one block: 0 when all of
+    // it is (or nothing is free), approaching 1 as it splinters.
+    float fragmentation() const;
+};
+
+// Allocator behind ALLOC, FREE and REALLOC over a region of VM memory. All of
+// its state lives in the region, so snapshots and forks carry the heap with
+// the rest of memory: a control block at the start holds the bump pointer and
+// one free-list head per size class, and each block has a one-cell header
+// before its payload (free blocks keep their list link in the payload).
+//
+// Requests round up to a size class (1, 2, 3, then 4 and 6 times each power
+// of two) and come from that class's free list, else the bump region, else
+// the smallest non-empty larger class. FREE puts a block back on its class
+// list. Blocks are never split or merged, so every operation but REALLOC's
+// copy takes constant time. The methods return nullptr or the fault message.
+class Heap {
+public:
+    static constexpr u32 CLASSES = 32;
+    static constexpr u32 CONTROL_CELLS = 1 + CLASSES; // bump pointer, free-list heads
+    static constexpr u32 MIN_CELLS = CONTROL_CELLS + 2;
+
+    Heap(u32 base, u32 cells) : m_base(base), m_end(base + cells) {}
+
+    u32 base() const { return m_base; }
+    u32 cells() const { return m_end - m_base; }
+
+    void init(i32* mem) const; // empty heap
+    const char* alloc(i32* mem, u32 n, u32& out) const; // out = 0 when n is 0 or nothing fits
+    const char* free(i32* mem, u32 p) const;            // p = 0 is ignored
+    const char* realloc(i32* mem, u32 p, u32 n, u32& out) const; // out = 0 keeps p when nothing fits
+    const char* stats(const i32* mem, HeapStats& out) const;
+
+    static u32 classSize(u32 c) { return c < 3 ? c + 1 : (((c - 3) & 1) ? 6u : 4u) << ((c - 3) / 2); }
+    static u32 classOf(u32 n); // n >= 1
+
+private:
+    u32 blocks() const { return m_base + CONTROL_CELLS; }
+    bool liveBlock(const i32* mem, u32 p) const; // p is the payload of an allocated block
+    bool takeFree(i32* mem, u32 c, u32& p) const; // pop class c's list (p = 0 if empty); false if corrupt
+
+    u32 m_base;
+    u32 m_end;
+};
+
+} // namespace vm32
@@ -0,0 +1,162 @@
+#include "input_record.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iterator>
+
+namespace vm32 {
+
+namespace {
+
+constexpr std::array<std::uint8_t, 8> kMagic = { 'L','J','I','R','\r','\n',0x1A,'\n' };
+constexpr u32 kVersion = 1;
+constexpr u32 kFlagHash = 1u << 0;
+
+void setError(std::string* outError, const std::string& msg) {
+    if (outError) *outError = msg;
+}
+
+void putFixed(std::vector<std::uint8_t>& out, std::uint64_t v, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i) out.push_back(static_cast<std::uint8_t>((v >> (8 * i)) & 0xFF));
+}
+
+bool getFixed(const std::vector<std::uint8_t>& in, std::size_t& pos, unsigned bytes, std::uint64_t& out) {
+    if (in.size() - pos < bytes) return false;
+    out = 0;
+    for (unsigned i = 0; i < bytes; ++i) out |= static_cast<std::uint64_t>(in[pos + i]) << (8 * i);
+    pos += bytes;
+    return true;
+}
+
+void putVarint(std::vector<std::uint8_t>& out, u32 v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+
+bool getVarint(const std::vector<std::uint8_t>& in, std::size_t& pos, u32& out) {
+    out = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (pos >= in.size()) return false;
+        const std::uint8_t b = in[pos++];
+        out |= static_cast<u32>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+std::uint64_t fnv1a64(const void* data, std::size_t bytes, std::uint64_t h) {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    for (std::size_t i = 0; i < bytes; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::uint64_t programHash(const std::vector<u32>& cells) {
+    return fnv1a64(cells.data(), cells.size() * sizeof(u32));
+}
+
+std::uint64_t framebufferHash(const VM& vm) {
+    return fnv1a64(vm.memData() + VM::FB_BASE, VM::FB_SIZE * sizeof(i32));
+}
+
+bool saveInputRecording(const InputRecording& rec, const std::string& path, std::string* outError) {
+    std::vector<std::uint8_t> buf(kMagic.begin(), kMagic.end());
+    putFixed(buf, kVersion, 4);
+    putFixed(buf, rec.programHash, 8);
+    putFixed(buf, rec.startupSteps, 4);
+    putFixed(buf, rec.frames.size(), 4);
+
+    u32 prevMs = 0;
+    for (const InputFrame& f : rec.frames) {
+        putVarint(buf, f.hasHash ? kFlagHash : 0);
+        putVarint(buf, f.nowMs - prevMs);
+        putVarint(buf, f.kbMask);
+        putVarint(buf, f.audioSamples);
+        putVarint(buf, f.steps);
+        putVarint(buf, static_cast<u32>(f.events.size()));
+        for (const ScriptedEvent& ev : f.events) {
+            putVarint(buf, ev.type);
+            putVarint(buf, ev.scancode);
+            putVarint(buf, ev.timeMs);
+        }
+        if (f.hasHash) putFixed(buf, f.fbHash, 8);
+        prevMs = f.nowMs;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        setError(outError, "Failed to open for write: " + path);
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+    if (!file) {
+        setError(outError, "Failed to write recording: " + path);
+        return false;
+    }
+    return true;
+}
+
+bool loadInputRecording(const std::string& path, InputRecording& out, std::string* outError) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        setError(outError, "Failed to open for read: " + path);
+        return false;
+    }
+    const std::vector<std::uint8_t> buf((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (buf.size() < kMagic.size() || !std::equal(kMagic.begin(), kMagic.end(), buf.begin())) {
+        setError(outError, "Bad magic (not an LJIR file)");
+        return false;
+    }
+    std::size_t pos = kMagic.size();
+    std::uint64_t version, progHash, startupSteps, frameCount;
+    if (!getFixed(buf, pos, 4, version) || !getFixed(buf, pos, 8, progHash) ||
+        !getFixed(buf, pos, 4, startupSteps) || !getFixed(buf, pos, 4, frameCount)) {
+        setError(outError, "Truncated recording header");
+        return false;
+    }
+    if (version != kVersion) {
+        setError(outError, "Unsupported recording version: " + std::to_string(version));
+        return false;
+    }
+
+    InputRecording rec;
+    rec.programHash = progHash;
+    rec.startupSteps = static_cast<u32>(startupSteps);
+    u32 prevMs = 0;
+    for (std::uint64_t i = 0; i < frameCount; ++i) {
+        InputFrame f;
+        u32 flags, dt, eventCount;
+        bool ok = getVarint(buf, pos, flags) && getVarint(buf, pos, dt) && getVarint(buf, pos, f.kbMask) &&
+                  getVarint(buf, pos, f.audioSamples) && getVarint(buf, pos, f.steps) &&
+                  getVarint(buf, pos, eventCount) && eventCount <= (buf.size() - pos) / 3;
+        for (u32 e = 0; ok && e < eventCount; ++e) {
+            ScriptedEvent ev;
+            ok = getVarint(buf, pos, ev.type) && getVarint(buf, pos, ev.scancode) && getVarint(buf, pos, ev.timeMs);
+            f.events.push_back(ev);
+        }
+        if (ok && (flags & kFlagHash)) {
+            f.hasHash = true;
+            ok = getFixed(buf, pos, 8, f.fbHash);
+        }
+        if (!ok) {
+            setError(outError, "Corrupt or truncated frame " + std::to_string(i));
+            return false;
+        }
+        f.nowMs = prevMs + dt;
+        prevMs = f.nowMs;
+        rec.frames.push_back(std::move(f));
+    }
+    out = std::move(rec);
+    return true;
+}
+
+} // namespace vm32
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "event_script.h"
+#include "vm.h"
+
+namespace vm32 {
+
+// One host frame: the input applied to the VM before the frame is run, and
+// what the frame produced, so a replay can check it stays in step.
+struct InputFrame {
+    u32 nowMs{0};                      // host clock for the frame (drives IRQ_TIMER)
+    u32 kbMask{0};                     // value written to KB_STATE_ADDR
+    std::vector<ScriptedEvent> events; // pushed to the event queue, in order
+    u32 audioSamples{0};               // samples the host took from the audio ring
+    u32 steps{0};                      // instructions executed by the frame
+    bool hasHash{false};               // checkpoint frame
+    std::uint64_t fbHash{0};           // framebufferHash() after the frame
+};
+
+struct InputRecording {
+    std::uint64_t programHash{0}; // programHash() of the recorded program
+    u32 startupSteps{0};          // instructions executed before the first frame
+    std::vector<InputFrame> frames;
+};
+
+// 64-bit FNV-1a.
+std::uint64_t fnv1a64(const void* data, std::size_t bytes, std::uint64_t h = 0xcbf29ce484222325ull);
+
+std::uint64_t programHash(const std::vector<u32>& cells);
+
+// Hash of the FB_SIZE framebuffer cells (not the composited tile/sprite output).
+std::uint64_t framebufferHash(const VM& vm);
+
+// File format:
+//   magic[8]     = "LJIR\r\n\x1A\n"
+//   version      = u32 (currently 1)
+//   programHash  = u64
+//   startupSteps = u32
+//   frameCount   = u32
+//   frames, each a run of unsigned LEB128 varints:
+//     flags (bit 0: hash follows), nowMs delta from the previous frame,
+//     kbMask, audioSamples, steps, eventCount, then per event
+//     type, scancode, timeMs; with bit 0 set the frame ends in a u64 hash.
+// Fixed-width fields are little-endian.
+
+bool saveInputRecording(const InputRecording& rec, const std::string& path, std::string* outError = nullptr);
+
+bool loadInputRecording(const std::string& path, InputRecording& out, std::string* outError = nullptr);
+
+} // namespace vm32
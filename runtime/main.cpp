@@ -1,16 +1,407 @@
 #include <SDL.h>
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <cstdint>
 #include "vm.h"
+#include "assets.h"
+#include "audio_out.h"
+#include "event_script.h"
+#include "input_record.h"
+#include "multicore.h"
+#include "native_module.h"
+#include "profiler.h"
+#include "video.h"
 #include "../bytecode/bytecode_builder.h"
+#include "../bytecode/bytecode_io.h"
+#include "../bytecode/line_map.h"
+#include "../bytecode/peephole.h"
+
+namespace {
+
+// Programs that park in HALT_UNTIL_IRQ are resumed once per frame (VBLANK),
+// with this many instructions available before the next frame.
+constexpr std::size_t kStepsPerFrame = 1'000'000;
+constexpr vm32::u32 kFrameMs = 1000 / 60; // virtual frame length in headless mode
+
+struct Options {
+    std::string programPath; // LJBC file; the built-in demo when empty
+    std::string eventsPath;  // scripted input events (see event_script.h)
+    bool headless{false};
+    bool audio{false};       // headless only; windowed mode always opens audio
+    std::size_t frames{600}; // headless only
+    std::string recordPath;  // write per-frame input to this file on exit
+    std::string replayPath;  // feed per-frame input from this file instead of live input
+    vm32::u32 checkpointEvery{60}; // frames between framebuffer hashes when recording
+    std::size_t traceEntries{64};  // instructions kept for the post-mortem trace (0 = off)
+    vm32::u32 profileInterval{0};  // instructions between profiler samples (0 = off)
+    std::string profileOutPath;    // collapsed stacks for flame graphs
+    std::string mapPath;           // source line map; defaults to program.ljmap if present
+    std::uint64_t gas{0};          // gas budget for the whole session (0 = unmetered)
+    vm32::u32 cores{1};            // cores for the startup run (see VM::CORE_ID_ADDR)
+    std::string nativePath;        // module built by the aot tool from this program
+    bool registerIr{false};        // run through register IR translated at load time
+    bool heapStats{false};         // print heap usage on exit
+    std::vector<std::string> blobPaths; // DMA blobs 0, 1, ... (see VM::DMA_FROM_BLOB)
+    std::vector<std::pair<std::string, vm32::u32>> assets; // file, cell address
+    std::string assetCache{".ljcache"}; // decoded PNGs; empty = no cache
+};
+
+void printUsage() {
+    std::printf("usage: runtime [program.ljbc] [--headless] [--frames N] [--events script.txt] [--audio]\n");
+    std::printf("               [--record out.ljir [--checkpoint N] | --replay in.ljir]\n");
+    std::printf("               [--trace N] [--profile N [--profile-out stacks.txt]] [--map program.ljmap]\n");
+    std::printf("               [--gas N] [--cores N] [--native module.so] [--regir] [--heap-stats]\n");
+    std::printf("               [--blob file]... [--asset file@addr]... [--asset-cache dir]\n");
+    std::printf("  --audio opens an audio device in headless mode; use SDL_AUDIODRIVER=dummy or disk\n");
+    std::printf("  --replay runs every recorded frame, checking step counts and framebuffer hashes\n");
+    std::printf("  --record and --replay finish each DMA transfer as it starts, so IRQ_DMA arrives at the same point\n");
+    std::printf("  --trace keeps the last N instructions and prints them if the VM faults (0 = off)\n");
+    std::printf("  --profile samples every N instructions and prints per-function and per-line reports on exit\n");
+    std::printf("  --gas meters the program with the default gas schedule and stops it when N is used up\n");
+    std::printf("  --cores runs the program up to its first halt on N cores (frames run on core 0 only)\n");
+    std::printf("  --native runs the program through a module built by the aot tool (turns off --trace)\n");
+    std::printf("  --regir translates the program to register code at load time (turns off --trace)\n");
+    std::printf("  --heap-stats prints heap usage and fragmentation on exit\n");
+    std::printf("  --asset copies a PNG (as ARGB8888 cells) or raw file (little-endian cells) to addr after loading\n");
+    std::printf("  --asset-cache keeps decoded PNGs in dir (default .ljcache, \"\" = off)\n");
+    std::printf("  --blob makes a file DMA blob 0, 1, ... in the order given, read as --asset reads it\n");
+}
 
-int main(int argc, char* argv[]) {
+bool parseArgs(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            opt.headless = true;
+        } else if (arg == "--audio") {
+            opt.audio = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            opt.frames = static_cast<std::size_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--events" && i + 1 < argc) {
+            opt.eventsPath = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            opt.recordPath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            opt.replayPath = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            opt.traceEntries = static_cast<std::size_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--profile" && i + 1 < argc) {
+            opt.profileInterval = static_cast<vm32::u32>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--profile-out" && i + 1 < argc) {
+            opt.profileOutPath = argv[++i];
+        } else if (arg == "--gas" && i + 1 < argc) {
+            opt.gas = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--cores" && i + 1 < argc) {
+            opt.cores = static_cast<vm32::u32>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--regir") {
+            opt.registerIr = true;
+        } else if (arg == "--heap-stats") {
+            opt.heapStats = true;
+        } else if (arg == "--blob" && i + 1 < argc) {
+            opt.blobPaths.push_back(argv[++i]);
+        } else if (arg == "--asset" && i + 1 < argc) {
+            const std::string spec = argv[++i];
+            const std::size_t at = spec.rfind('@');
+            if (at == std::string::npos || at == 0 || at + 1 == spec.size()) return false;
+            opt.assets.emplace_back(spec.substr(0, at),
+                                    static_cast<vm32::u32>(std::strtoul(spec.c_str() + at + 1, nullptr, 0)));
+        } else if (arg == "--asset-cache" && i + 1 < argc) {
+            opt.assetCache = argv[++i];
+        } else if (arg == "--native" && i + 1 < argc) {
+            opt.nativePath = argv[++i];
+        } else if (arg == "--map" && i + 1 < argc) {
+            opt.mapPath = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            opt.checkpointEvery = static_cast<vm32::u32>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (!arg.empty() && arg[0] != '-' && opt.programPath.empty()) {
+            opt.programPath = arg;
+        } else {
+            return false;
+        }
+    }
+    // Multi-core runs are not deterministic, so they cannot be recorded or replayed.
+    if (opt.cores > 1 && (!opt.recordPath.empty() || !opt.replayPath.empty())) return false;
+    return opt.recordPath.empty() || opt.replayPath.empty();
+}
 
-    std::cout << "runtime " << std::endl;
+// VM drawing demo: fill the memory-mapped framebuffer using a loop.
+// Any STORE/STORE_IND/STORE_IDX into [VM::FB_BASE, VM::FB_BASE + VM::FB_SIZE) becomes a pixel.
+std::vector<vm32::u32> buildDemoProgram() {
+    using namespace vm32;
+    BytecodeBuilder bc;
+
+    // Variables in data memory
+    const u32 I    = VM::DATA_BASE + 0; // loop counter
+
+    const u32 FB_N = VM::FB_SIZE;
+
+    // i = 0
+    bc.pushi(0).store(I);
+
+    const u32 LOOP = static_cast<u32>(bc.pc());
+
+    // if (i < FB_SIZE) continue; else goto END
+    bc.load(I).pushi(static_cast<i32>(FB_N)).cmplt();
+    bc.jz(0);
+    const u32 jz_end_patch = static_cast<u32>(bc.pc()) - 1; // target cell index
+
+    // Checker/stripe-ish pattern: ((i % 32) < 16) ? color1 : color2
+    bc.load(I).pushi(32).mod().pushi(16).cmplt();
+    bc.jz(0);
+    const u32 jz_else_patch = static_cast<u32>(bc.pc()) - 1; // target cell index
+
+    // THEN: color1 -> mem[FB_BASE + i]
+    bc.pushi(static_cast<i32>(0xFF33AAFFu));
+    bc.load(I);
+    bc.store_idx(VM::FB_BASE);
+    bc.jmp(0);
+    const u32 jmp_inc_patch = static_cast<u32>(bc.pc()) - 1; // target cell index
+
+    // ELSE:
+    const u32 ELSE = static_cast<u32>(bc.pc());
+    bc.pushi(static_cast<i32>(0xFFFF2244u));
+    bc.load(I);
+    bc.store_idx(VM::FB_BASE);
+
+    // INC:
+    const u32 INC = static_cast<u32>(bc.pc());
+    bc.load(I).pushi(1).add().store(I);
+    bc.jmp(LOOP);
+
+    const u32 END = static_cast<u32>(bc.pc());
+    bc.halt();
+
+    // Patch jump targets
+    bc.code[jz_end_patch] = END;
+    bc.code[jz_else_patch] = ELSE;
+    bc.code[jmp_inc_patch] = INC;
+
+    // Fold the CMP_LT + JZ pairs above into single fused branches.
+    std::string fuseError;
+    if (!fuseCompareBranches(bc.code, nullptr, &fuseError)) {
+        std::printf("Branch fusion skipped: %s\n", fuseError.c_str());
+    }
+
+    return bc.code;
+}
+
+// Update memory-mapped keyboard/gamepad state.
+// VM bytecode can read this with: LOAD VM::KB_STATE_ADDR
+vm32::u32 sampleKeyboard() {
+    SDL_PumpEvents();
+    const Uint8* keys = SDL_GetKeyboardState(nullptr);
+    vm32::u32 kb = 0;
+    if (keys[SDL_SCANCODE_UP])    kb |= vm32::VM::KB_UP;
+    if (keys[SDL_SCANCODE_DOWN])  kb |= vm32::VM::KB_DOWN;
+    if (keys[SDL_SCANCODE_LEFT])  kb |= vm32::VM::KB_LEFT;
+    if (keys[SDL_SCANCODE_RIGHT]) kb |= vm32::VM::KB_RIGHT;
+
+    // Typical retro mappings
+    if (keys[SDL_SCANCODE_Z])      kb |= vm32::VM::KB_A;
+    if (keys[SDL_SCANCODE_X])      kb |= vm32::VM::KB_B;
+    if (keys[SDL_SCANCODE_A])      kb |= vm32::VM::KB_X;
+    if (keys[SDL_SCANCODE_S])      kb |= vm32::VM::KB_Y;
+    if (keys[SDL_SCANCODE_Q])      kb |= vm32::VM::KB_L;
+    if (keys[SDL_SCANCODE_E])      kb |= vm32::VM::KB_R;
+    if (keys[SDL_SCANCODE_RSHIFT]) kb |= vm32::VM::KB_SELECT;
+    if (keys[SDL_SCANCODE_RETURN]) kb |= vm32::VM::KB_START;
+    return kb;
+}
+
+// Host work done once per frame in both windowed and headless mode: raise
+// interrupt sources, resume a parked program, then flush console output.
+struct FrameState {
+    vm32::u32 lastTimerTick{0};
+    bool vmWaiting{false};
+};
+
+std::size_t runFrame(vm32::VM& vm, vm32::u32 nowMs, FrameState& fs) {
+    // Interrupt sources: VBLANK every frame, TIMER at the program-selected period.
+    const vm32::u32 timerPeriod = static_cast<vm32::u32>(vm.memAt(vm32::VM::TIMER_PERIOD_ADDR));
+    if (timerPeriod != 0 && nowMs - fs.lastTimerTick >= timerPeriod) {
+        vm.raiseIrq(vm32::VM::IRQ_TIMER);
+        fs.lastTimerTick = nowMs;
+    }
+    vm.raiseIrq(vm32::VM::IRQ_VBLANK);
+
+    std::size_t steps = 0;
+    if (fs.vmWaiting) {
+        auto r = vm.run(kStepsPerFrame);
+        if (!r.ok) {
+            std::printf("VM error at 0x%04x: %s\n", r.faultIp, r.error.c_str());
+        } else if (r.outOfGas) {
+            std::printf("VM out of gas at 0x%04x\n", vm.ip());
+        }
+        fs.vmWaiting = r.ok && r.waiting;
+        steps = r.steps;
+    }
+
+    // Frame boundary: emit text console contents and any buffered PRINT output.
+    vm.drainConsole();
+    vm.flushOutput();
+    return steps;
+}
+
+// Per-frame input recording (--record) and replay (--replay). Live frames are
+// appended to the recording; replayed frames take their input from it and are
+// checked against the recorded step counts and framebuffer hashes.
+class InputSession {
+public:
+    bool recording() const { return m_recording; }
+    bool replaying() const { return m_replaying; }
+    bool replayDone() const { return m_next >= m_rec.frames.size(); }
+
+    void startRecording(std::uint64_t progHash, std::size_t startupSteps, vm32::u32 checkpointEvery) {
+        m_recording = true;
+        m_rec.programHash = progHash;
+        m_rec.startupSteps = static_cast<vm32::u32>(startupSteps);
+        m_checkpointEvery = checkpointEvery;
+    }
+
+    bool startReplay(const std::string& path, std::uint64_t progHash, std::size_t startupSteps) {
+        std::string err;
+        if (!vm32::loadInputRecording(path, m_rec, &err)) {
+            std::printf("Replay error: %s\n", err.c_str());
+            return false;
+        }
+        if (m_rec.programHash != progHash) {
+            std::printf("Replay error: recording was made with a different program\n");
+            return false;
+        }
+        if (m_rec.startupSteps != startupSteps) {
+            std::printf("replay: startup ran %zu steps, recorded %u\n", startupSteps, m_rec.startupSteps);
+            ++m_mismatches;
+        }
+        m_replaying = true;
+        m_started = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    // Replay: apply the next recorded frame's input to the VM and return it.
+    const vm32::InputFrame& replayInput(vm32::VM& vm) {
+        const vm32::InputFrame& in = m_rec.frames[m_next];
+        for (const auto& ev : in.events) vm.pushInputEvent(ev.type, ev.scancode, ev.timeMs);
+        vm.setKeyboardState(in.kbMask);
+        return in;
+    }
 
+    // Samples to take from the VM's audio ring this frame: as many as the device
+    // accepts when live, exactly the recorded count on replay.
+    vm32::u32 takeAudio(vm32::VM& vm, vm32::AudioOut& audio) {
+        if (!m_replaying) return audio.isOpen() ? static_cast<vm32::u32>(audio.pump(vm)) : 0;
+        const vm32::u32 want = m_rec.frames[m_next].audioSamples;
+        std::size_t got = audio.isOpen() ? audio.pump(vm, want) : 0;
+        std::int16_t discard[256];
+        while (got < want) {
+            const std::size_t n = vm.readAudio(discard, std::min<std::size_t>(want - got, 256));
+            if (n == 0) break;
+            got += n;
+        }
+        return want;
+    }
+
+    // After the frame ran: record it, or check it against the recording.
+    void endFrame(const vm32::VM& vm, vm32::InputFrame& frame) {
+        if (m_recording) {
+            const std::size_t index = m_rec.frames.size();
+            if (m_checkpointEvery != 0 && (index + 1) % m_checkpointEvery == 0) {
+                frame.hasHash = true;
+                frame.fbHash = vm32::framebufferHash(vm);
+            }
+            m_rec.frames.push_back(std::move(frame));
+        } else if (m_replaying) {
+            const vm32::InputFrame& rec = m_rec.frames[m_next];
+            m_steps += frame.steps;
+            if (frame.steps != rec.steps && report()) {
+                std::printf("replay: frame %zu ran %u steps, recorded %u\n", m_next, frame.steps, rec.steps);
+            }
+            if (rec.hasHash) {
+                ++m_checkpoints;
+                if (vm32::framebufferHash(vm) != rec.fbHash && report()) {
+                    std::printf("replay: frame %zu framebuffer hash differs\n", m_next);
+                }
+            }
+            ++m_next;
+        }
+    }
+
+    // Write the recording or print the replay summary. Returns the process exit code.
+    int finish(const std::string& recordPath) {
+        if (m_recording) {
+            std::string err;
+            if (!vm32::saveInputRecording(m_rec, recordPath, &err)) {
+                std::printf("Record error: %s\n", err.c_str());
+                return 1;
+            }
+            std::printf("record: %zu frames -> %s\n", m_rec.frames.size(), recordPath.c_str());
+        } else if (m_replaying) {
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_started).count();
+            std::printf("replay: %zu/%zu frames, %llu steps in %.1f ms (%.1f Msteps/s), %zu checkpoints, %zu mismatches\n",
+                        m_next, m_rec.frames.size(), static_cast<unsigned long long>(m_steps), ms,
+                        ms > 0 ? static_cast<double>(m_steps) / ms / 1000.0 : 0.0, m_checkpoints, m_mismatches);
+            return (m_mismatches == 0 && replayDone()) ? 0 : 1;
+        }
+        return 0;
+    }
+
+private:
+    // Count a mismatch; only the first few are printed.
+    bool report() { return m_mismatches++ < 10; }
+
+    vm32::InputRecording m_rec;
+    bool m_recording{false};
+    bool m_replaying{false};
+    vm32::u32 m_checkpointEvery{0};
+    std::size_t m_next{0}; // replay position
+    std::size_t m_mismatches{0};
+    std::size_t m_checkpoints{0};
+    std::uint64_t m_steps{0};
+    std::chrono::steady_clock::time_point m_started;
+};
+
+// Run without a window on a virtual 60 Hz clock until the program stops
+// waiting for interrupts or the frame limit is reached.
+int runHeadless(vm32::VM& vm, const Options& opt, vm32::EventFeeder& feeder, FrameState& fs, InputSession& session) {
+    vm32::AudioOut audio;
+    if (opt.audio) {
+        std::string err;
+        if (SDL_Init(SDL_INIT_AUDIO) != 0) {
+            std::printf("SDL_Init Error: %s\n", SDL_GetError());
+        } else if (!audio.open(&err)) {
+            std::printf("%s\n", err.c_str());
+        }
+    }
+
+    // A replay runs every recorded frame regardless of --frames.
+    std::size_t frame = 0;
+    for (; (session.replaying() ? !session.replayDone() : frame < opt.frames) && fs.vmWaiting; ++frame) {
+        vm32::InputFrame in;
+        if (session.replaying()) {
+            in.nowMs = session.replayInput(vm).nowMs;
+        } else {
+            in.nowMs = static_cast<vm32::u32>(frame) * kFrameMs;
+            feeder.feed(vm, in.nowMs, &in.events);
+            in.kbMask = vm.keyboardState();
+        }
+        in.steps = static_cast<vm32::u32>(runFrame(vm, in.nowMs, fs));
+        in.audioSamples = session.takeAudio(vm, audio);
+        session.endFrame(vm, in);
+    }
+    vm.flushOutput();
+    std::printf("headless: %zu frames\n", frame);
+
+    if (opt.audio) {
+        audio.close();
+        SDL_Quit();
+    }
+    return 0;
+}
+
+int runWindowed(vm32::VM& vm, vm32::EventFeeder& feeder, FrameState& fs, InputSession& session) {
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
 
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
@@ -18,12 +409,23 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // Audio is optional: without a device the VM's audio ring simply fills up.
+    vm32::AudioOut audio;
+    {
+        std::string err;
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+            std::printf("SDL_InitSubSystem(AUDIO) Error: %s\n", SDL_GetError());
+        } else if (!audio.open(&err)) {
+            std::printf("%s\n", err.c_str());
+        }
+    }
+
     std::printf("Hello SDL\n");
-    
+
     SDL_Window* window = SDL_CreateWindow(
-        "LangJam SDL", 
+        "LangJam SDL",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        256, 192, 
+        256, 192,
         SDL_WINDOW_SHOWN
     );
 
@@ -37,7 +439,7 @@ int main(int argc, char* argv[]) {
     SDL_SetWindowSize(window, vm32::VM::FB_WIDTH * 4, vm32::VM::FB_HEIGHT * 4);
 
     SDL_Renderer* renderer = SDL_CreateRenderer( window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
-    
+
     if (!renderer) {
         std::printf("SDL_CreateRenderer Error: %s\n", SDL_GetError());
         SDL_DestroyWindow(window);
@@ -70,111 +472,45 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    vm32::VM vm;
-
-    // VM drawing demo: fill the memory-mapped framebuffer using a loop.
-    // Any STORE/STORE_IND into [VM::FB_BASE, VM::FB_BASE + VM::FB_SIZE) becomes a pixel.
-    {
-        using namespace vm32;
-        BytecodeBuilder bc;
-
-        // Variables in data memory
-        const u32 I    = VM::DATA_BASE + 0; // loop counter
-        const u32 ADDR = VM::DATA_BASE + 1; // computed framebuffer address
-
-        const u32 FB_N = VM::FB_SIZE;
-
-        // i = 0
-        bc.pushi(0).store(I);
-
-        const u32 LOOP = static_cast<u32>(bc.pc());
-
-        // if (i < FB_SIZE) continue; else goto END
-        bc.load(I).pushi(static_cast<i32>(FB_N)).cmplt();
-        bc.jz(0);
-        const u32 jz_end_patch = static_cast<u32>(bc.pc()) - 1; // target cell index
-
-        // addr = FB_BASE + i
-        bc.pushi(static_cast<i32>(VM::FB_BASE)).load(I).add().store(ADDR);
-
-        // Checker/stripe-ish pattern: ((i % 32) < 16) ? color1 : color2
-        bc.load(I).pushi(32).mod().pushi(16).cmplt();
-        bc.jz(0);
-        const u32 jz_else_patch = static_cast<u32>(bc.pc()) - 1; // target cell index
-
-        // THEN: color1
-        bc.pushi(static_cast<i32>(0xFF33AAFFu));
-        bc.load(ADDR);
-        bc.store_ind();
-        bc.jmp(0);
-        const u32 jmp_inc_patch = static_cast<u32>(bc.pc()) - 1; // target cell index
-
-        // ELSE:
-        const u32 ELSE = static_cast<u32>(bc.pc());
-        bc.pushi(static_cast<i32>(0xFFFF2244u));
-        bc.load(ADDR);
-        bc.store_ind();
-
-        // INC:
-        const u32 INC = static_cast<u32>(bc.pc());
-        bc.load(I).pushi(1).add().store(I);
-        bc.jmp(LOOP);
-
-        const u32 END = static_cast<u32>(bc.pc());
-        bc.halt();
-
-        // Patch jump targets
-        bc.code[jz_end_patch] = END;
-        bc.code[jz_else_patch] = ELSE;
-        bc.code[jmp_inc_patch] = INC;
-
-        vm.load(bc.code);
-
-        auto r = vm.run(5'000'000);
-        
-        if (!r.ok) {
-            std::printf("VM error: %s\n", r.error.c_str());
-        }
-    }
-
     std::vector<std::uint32_t> pixels(vm32::VM::FB_SIZE);
 
+    const Uint32 startTicks = SDL_GetTicks();
+    fs.lastTimerTick = 0;
+
     bool running = true;
     SDL_Event e;
     while (running) {
+        // Key events go to the VM's event queue as they arrive, stamped with
+        // SDL's timestamp on the same clock as nowMs, so presses shorter than a
+        // frame are not lost. On replay live input is ignored.
+        vm32::InputFrame in;
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_QUIT) {
                 running = false;
+            } else if ((e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) && !e.key.repeat && !session.replaying()) {
+                const Uint32 at = e.key.timestamp > startTicks ? e.key.timestamp - startTicks : 0; // may predate the loop
+                const vm32::ScriptedEvent ev{ at,
+                                              e.type == SDL_KEYDOWN ? vm32::VM::EV_KEY_DOWN : vm32::VM::EV_KEY_UP,
+                                              static_cast<vm32::u32>(e.key.keysym.scancode) };
+                if (vm.pushInputEvent(ev.type, ev.scancode, ev.timeMs)) in.events.push_back(ev);
             }
         }
 
-        // Update memory-mapped keyboard/gamepad state.
-        // VM bytecode can read this with: LOAD VM::KB_STATE_ADDR
-        SDL_PumpEvents();
-        const Uint8* keys = SDL_GetKeyboardState(nullptr);
-        vm32::u32 kb = 0;
-        if (keys[SDL_SCANCODE_UP])    kb |= vm32::VM::KB_UP;
-        if (keys[SDL_SCANCODE_DOWN])  kb |= vm32::VM::KB_DOWN;
-        if (keys[SDL_SCANCODE_LEFT])  kb |= vm32::VM::KB_LEFT;
-        if (keys[SDL_SCANCODE_RIGHT]) kb |= vm32::VM::KB_RIGHT;
-
-        // Typical retro mappings
-        if (keys[SDL_SCANCODE_Z])      kb |= vm32::VM::KB_A;
-        if (keys[SDL_SCANCODE_X])      kb |= vm32::VM::KB_B;
-        if (keys[SDL_SCANCODE_A])      kb |= vm32::VM::KB_X;
-        if (keys[SDL_SCANCODE_S])      kb |= vm32::VM::KB_Y;
-        if (keys[SDL_SCANCODE_Q])      kb |= vm32::VM::KB_L;
-        if (keys[SDL_SCANCODE_E])      kb |= vm32::VM::KB_R;
-        if (keys[SDL_SCANCODE_RSHIFT]) kb |= vm32::VM::KB_SELECT;
-        if (keys[SDL_SCANCODE_RETURN]) kb |= vm32::VM::KB_START;
-
-        vm.setKeyboardState(kb);
-
-        // Copy VM framebuffer memory into a texture and display it.
-        for (std::size_t i = 0; i < pixels.size(); ++i) {
-            const vm32::u32 addr = vm32::VM::FB_BASE + static_cast<vm32::u32>(i);
-            pixels[i] = static_cast<std::uint32_t>(vm.memAt(addr));
+        if (session.replaying()) {
+            if (session.replayDone()) break;
+            in.nowMs = session.replayInput(vm).nowMs;
+        } else {
+            in.kbMask = sampleKeyboard();
+            vm.setKeyboardState(in.kbMask);
+            in.nowMs = SDL_GetTicks() - startTicks;
+            feeder.feed(vm, in.nowMs, &in.events);
         }
+        in.steps = static_cast<vm32::u32>(runFrame(vm, in.nowMs, fs));
+        in.audioSamples = session.takeAudio(vm, audio);
+        session.endFrame(vm, in);
+
+        // Composite the framebuffer plus tile/sprite layers into a texture and display it.
+        vm32::composeFrame(vm, pixels.data());
 
         SDL_UpdateTexture(
             framebufferTex,
@@ -188,9 +524,153 @@ int main(int argc, char* argv[]) {
         SDL_RenderPresent(renderer);
     }
 
+    audio.close();
     SDL_DestroyTexture(framebufferTex);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
     return 0;
 }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+    std::cout << "runtime " << std::endl;
+
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<vm32::u32> program;
+    if (opt.programPath.empty()) {
+        program = buildDemoProgram();
+    } else {
+        std::string err;
+        if (!vm32::loadBytecodeFromFile(opt.programPath, program, &err)) {
+            std::printf("Load error: %s\n", err.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<vm32::ScriptedEvent> events;
+    if (!opt.eventsPath.empty()) {
+        std::string err;
+        if (!vm32::loadEventScript(opt.eventsPath, events, &err)) {
+            std::printf("Event script error: %s\n", err.c_str());
+            return 1;
+        }
+    }
+    vm32::EventFeeder feeder(std::move(events));
+
+    // The line map only matters to the profiler; a missing default map is not an error.
+    vm32::LineMap lineMap;
+    bool haveLineMap = false;
+    if (opt.profileInterval != 0) {
+        std::string mapPath = opt.mapPath;
+        const std::string ext = ".ljbc";
+        if (mapPath.empty() && opt.programPath.size() > ext.size() &&
+            opt.programPath.compare(opt.programPath.size() - ext.size(), ext.size(), ext) == 0) {
+            mapPath = opt.programPath.substr(0, opt.programPath.size() - ext.size()) + ".ljmap";
+            std::FILE* probe = std::fopen(mapPath.c_str(), "r");
+            if (probe) std::fclose(probe);
+            else mapPath.clear();
+        }
+        std::string err;
+        if (!mapPath.empty()) {
+            if (!vm32::loadLineMap(mapPath, lineMap, &err)) {
+                std::printf("Line map error: %s\n", err.c_str());
+                return 1;
+            }
+            haveLineMap = true;
+        }
+    }
+
+    // Translated code only runs untraced, so it replaces the post-mortem trace.
+    if (opt.registerIr || !opt.nativePath.empty()) opt.traceEntries = 0;
+
+    vm32::VM vm(opt.cores > 1 ? vm32::VM::CORE_STACK_CELLS : 1024);
+    vm.enableTrace(opt.traceEntries);
+    vm.enableProfiler(opt.profileInterval);
+    vm.setRegisterIr(opt.registerIr);
+    vm.setDmaSynchronous(!opt.recordPath.empty() || !opt.replayPath.empty()); // IRQ_DMA must not depend on host timing
+    if (opt.blobPaths.size() > vm32::VM::MAX_DMA_BLOBS) {
+        std::printf("Too many blobs (at most %u)\n", vm32::VM::MAX_DMA_BLOBS);
+        return 1;
+    }
+    for (std::size_t i = 0; i < opt.blobPaths.size(); ++i) {
+        vm32::Image img;
+        std::string err;
+        if (!vm32::loadAsset(opt.blobPaths[i], opt.assetCache, img, nullptr, &err)) {
+            std::printf("Blob error: %s\n", err.c_str());
+            return 1;
+        }
+        vm.setDmaBlob(static_cast<vm32::u32>(i), std::make_shared<const std::vector<vm32::i32>>(std::move(img.cells)));
+    }
+    vm.load(program);
+    for (const auto& asset : opt.assets) {
+        vm32::Image img;
+        std::string err;
+        if (!vm32::loadAsset(asset.first, opt.assetCache, img, nullptr, &err)) {
+            std::printf("Asset error: %s\n", err.c_str());
+            return 1;
+        }
+        if (!vm.writeMem(asset.second, img.cells.data(), img.cells.size(), &err)) {
+            std::printf("Asset error: %s: %s\n", asset.first.c_str(), err.c_str());
+            return 1;
+        }
+    }
+
+    vm32::NativeModule native;
+    if (!opt.nativePath.empty()) {
+        std::string err;
+        if (!native.open(opt.nativePath, &err) || !vm.attachNative(native.program(), &err)) {
+            std::printf("Native module error: %s\n", err.c_str());
+            return 1;
+        }
+    }
+
+    FrameState fs;
+    if (opt.gas != 0) vm.setGas(opt.gas);
+    auto r = opt.cores > 1 ? vm32::runCores(vm, opt.cores, 5'000'000) : vm.run(5'000'000);
+    if (!r.ok) {
+        std::printf("VM error at 0x%04x: %s\n", r.faultIp, r.error.c_str());
+    } else if (r.outOfGas) {
+        std::printf("VM out of gas at 0x%04x\n", vm.ip());
+    }
+    fs.vmWaiting = r.ok && r.waiting;
+
+    InputSession session;
+    if (!opt.recordPath.empty()) {
+        session.startRecording(vm32::programHash(program), r.steps, opt.checkpointEvery);
+    } else if (!opt.replayPath.empty() && !session.startReplay(opt.replayPath, vm32::programHash(program), r.steps)) {
+        return 1;
+    }
+
+    const int rc = opt.headless ? runHeadless(vm, opt, feeder, fs, session) : runWindowed(vm, feeder, fs, session);
+    const int sessionRc = session.finish(opt.recordPath);
+
+    if (opt.profileInterval != 0) {
+        const auto samples = vm.profileSamples();
+        vm32::writeProfileReport(stdout, samples, opt.profileInterval, haveLineMap ? &lineMap : nullptr);
+        std::string err;
+        if (!opt.profileOutPath.empty() &&
+            !vm32::writeCollapsedStacks(opt.profileOutPath, samples, haveLineMap ? &lineMap : nullptr, &err)) {
+            std::printf("Profile error: %s\n", err.c_str());
+        }
+    }
+    if (opt.heapStats) {
+        vm32::HeapStats hs;
+        std::string err;
+        if (!vm.heapStats(hs, &err)) {
+            std::printf("Heap error: %s\n", err.c_str());
+        } else {
+            std::printf("Heap: %u live blocks (%u cells), %u free blocks (%u cells, largest %u), %u of %u cells untouched, fragmentation %.1f%%\n",
+                        hs.liveBlocks, hs.usedCells, hs.freeBlocks, hs.freeCells, hs.largestFree, hs.bumpCells, hs.capacity,
+                        hs.fragmentation() * 100.0);
+        }
+    }
+    return rc != 0 ? rc : sessionRc;
+}
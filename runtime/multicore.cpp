@@ -0,0 +1,109 @@
+#include "multicore.h"
+
+#include <atomic>
+#include <thread>
+
+namespace vm32 {
+
+void CoreBarrier::arriveAndWait() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (m_cancelled) return;
+    if (++m_arrived >= m_count) {
+        m_arrived = 0;
+        ++m_generation;
+        m_cv.notify_all();
+        return;
+    }
+    const std::uint64_t gen = m_generation;
+    m_cv.wait(lock, [&] { return m_generation != gen || m_cancelled; });
+}
+
+void CoreBarrier::arriveAndDrop() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_count > 0) --m_count;
+    if (m_arrived > 0 && m_arrived >= m_count) {
+        m_arrived = 0;
+        ++m_generation;
+        m_cv.notify_all();
+    }
+}
+
+void CoreBarrier::cancel() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_cancelled = true;
+    m_cv.notify_all();
+}
+
+namespace {
+
+// VM::run() for one core, giving up early once another core has faulted.
+Result runCore(VM& core, std::size_t maxSteps, const std::atomic<bool>& stop) {
+    Result r{};
+    std::size_t executed = 0;
+    for (std::size_t i = 0; i < maxSteps; ++i) {
+        if (stop.load(std::memory_order_relaxed)) { r.steps = executed; return r; }
+        r = core.step();
+        if (!r.ok) { core.flushOutput(); r.steps = executed; return r; }
+        if (r.steps == 0) { r.steps = executed; return r; }
+        executed += r.steps;
+    }
+    r.ok = false;
+    r.error = "Exceeded maxSteps";
+    r.steps = executed;
+    r.faultIp = core.ip();
+    return r;
+}
+
+} // namespace
+
+Result runCores(VM& vm, u32 count, std::size_t maxSteps) {
+    std::vector<std::unique_ptr<VM>> cores;
+    std::string error;
+    if (!vm.makeCores(count, cores, &error)) {
+        Result r{};
+        r.ok = false;
+        r.error = error;
+        r.faultIp = vm.ip();
+        return r;
+    }
+
+    const std::shared_ptr<CoreBarrier> barrier = vm.coreBarrier();
+    std::atomic<bool> stop{false};
+    std::vector<Result> results(count);
+    auto finish = [&](u32 k, const Result& r) {
+        results[k] = r;
+        if (!r.ok) {
+            stop.store(true, std::memory_order_relaxed);
+            barrier->cancel();
+        } else {
+            barrier->arriveAndDrop();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(cores.size());
+    for (u32 k = 1; k < count; ++k) {
+        threads.emplace_back([&, k] { finish(k, runCore(*cores[k - 1], maxSteps, stop)); });
+    }
+    finish(0, runCore(vm, maxSteps, stop));
+    for (std::thread& t : threads) t.join();
+    cores.clear();
+    vm.releaseCores();
+
+    Result out = results[0];
+    u32 faulted = count; // first core that faulted
+    std::size_t steps = 0;
+    for (u32 k = 0; k < count; ++k) {
+        steps += results[k].steps;
+        if (faulted == count && !results[k].ok) {
+            out = results[k];
+            faulted = k;
+        }
+        if (results[k].outOfGas) out.outOfGas = true; // the cores share one budget
+    }
+    if (faulted < count) out.error = "core " + std::to_string(faulted) + ": " + out.error;
+    out.steps = steps;
+    return out;
+}
+
+} // namespace vm32
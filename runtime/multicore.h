@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+#include "vm.h"
+
+namespace vm32 {
+
+// Barrier behind VM::BARRIER_ADDR. Each generation completes when every
+// remaining participant has arrived; a participant that drops out stops
+// counting toward later generations (and may complete the current one).
+class CoreBarrier {
+public:
+    explicit CoreBarrier(u32 count) : m_count(count) {}
+
+    void arriveAndWait();
+    void arriveAndDrop();
+    void cancel(); // release all waiters now and from then on
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    u32 m_count;
+    u32 m_arrived{0};
+    std::uint64_t m_generation{0};
+    bool m_cancelled{false};
+};
+
+// Run `count` cores of `vm` (see VM::makeCores()) until each halts, up to
+// maxSteps instructions per core. Core 0 is `vm` itself and runs on the
+// calling thread; the others get a host thread each and are released before
+// returning. A fault on any core stops the rest and is returned with the
+// error prefixed by the core id; otherwise the result is core 0's, marked
+// outOfGas if any core ran out of the shared budget. Steps are summed over
+// the cores.
+Result runCores(VM& vm, u32 count, std::size_t maxSteps = 1'000'000);
+
+} // namespace vm32
@@ -0,0 +1,30 @@
+#include "native_module.h"
+
+#include <SDL.h>
+
+namespace vm32 {
+
+bool NativeModule::open(const std::string& path, std::string* outError) {
+    close();
+    m_handle = SDL_LoadObject(path.c_str());
+    if (!m_handle) {
+        if (outError) *outError = std::string("SDL_LoadObject Error: ") + SDL_GetError();
+        return false;
+    }
+    const auto entry = reinterpret_cast<LjAotProgramFn>(SDL_LoadFunction(m_handle, LJ_AOT_PROGRAM_SYMBOL));
+    m_program = entry ? entry() : nullptr;
+    if (!m_program) {
+        if (outError) *outError = path + " is not a native program module";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void NativeModule::close() {
+    if (m_handle) SDL_UnloadObject(m_handle);
+    m_handle = nullptr;
+    m_program = nullptr;
+}
+
+} // namespace vm32
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+
+#include "aot_abi.h"
+
+namespace vm32 {
+
+// Shared object built from aot output, opened with SDL_LoadObject(). Pass
+// program() to VM::attachNative(); keep the module open while it is attached.
+class NativeModule {
+public:
+    NativeModule() = default;
+    ~NativeModule() { close(); }
+    NativeModule(const NativeModule&) = delete;
+    NativeModule& operator=(const NativeModule&) = delete;
+
+    bool open(const std::string& path, std::string* outError = nullptr);
+    void close();
+    const LjAotProgram* program() const { return m_program; }
+
+private:
+    void* m_handle{nullptr};
+    const LjAotProgram* m_program{nullptr};
+};
+
+} // namespace vm32
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// SWAR helpers for the packed-lane opcodes: a 32-bit cell is treated as
+// 4 x 8-bit or 2 x 16-bit unsigned lanes. All lanes are processed with plain
+// 32-bit integer ops; the high bit of every lane is handled separately so no
+// carry or borrow leaks into the neighbouring lane.
+namespace lanes {
+
+template <unsigned Bits> struct Layout;
+template <> struct Layout<8>  { static constexpr u32 H = 0x80808080u; static constexpr u32 MAX = 0xFFu; };
+template <> struct Layout<16> { static constexpr u32 H = 0x80008000u; static constexpr u32 MAX = 0xFFFFu; };
+
+// Expand the high bit of each lane into a full-lane mask.
+template <unsigned Bits> inline u32 laneMask(u32 highBits) {
+    return (highBits >> (Bits - 1)) * Layout<Bits>::MAX;
+}
+
+template <unsigned Bits> inline u32 add(u32 a, u32 b) {
+    constexpr u32 H = Layout<Bits>::H;
+    return ((a & ~H) + (b & ~H)) ^ ((a ^ b) & H);
+}
+
+template <unsigned Bits> inline u32 sub(u32 a, u32 b) {
+    constexpr u32 H = Layout<Bits>::H;
+    return ((a | H) - (b & ~H)) ^ ((a ^ ~b) & H);
+}
+
+// Lanes where a < b (unsigned): the borrow out of each lane's top bit.
+template <unsigned Bits> inline u32 ltMask(u32 a, u32 b) {
+    const u32 d = sub<Bits>(a, b);
+    return laneMask<Bits>(((~a & b) | (~(a ^ b) & d)) & Layout<Bits>::H);
+}
+
+template <unsigned Bits> inline u32 addSat(u32 a, u32 b) {
+    const u32 s = add<Bits>(a, b);
+    const u32 carry = ((a & b) | ((a | b) & ~s)) & Layout<Bits>::H;
+    return s | laneMask<Bits>(carry);
+}
+
+template <unsigned Bits> inline u32 subSat(u32 a, u32 b) {
+    return sub<Bits>(a, b) & ~ltMask<Bits>(a, b);
+}
+
+template <unsigned Bits> inline u32 min(u32 a, u32 b) {
+    const u32 m = ltMask<Bits>(a, b);
+    return (a & m) | (b & ~m);
+}
+
+template <unsigned Bits> inline u32 max(u32 a, u32 b) {
+    const u32 m = ltMask<Bits>(a, b);
+    return (b & m) | (a & ~m);
+}
+
+// Rounding-up average, (a + b + 1) >> 1 per lane.
+template <unsigned Bits> inline u32 avg(u32 a, u32 b) {
+    return (a | b) - (((a ^ b) >> 1) & ~Layout<Bits>::H);
+}
+
+// Scaled multiply: each lane becomes round(a * b / MAX), so MAX acts as 1.0.
+inline u32 mul8(u32 a, u32 b) {
+    u32 out = 0;
+    for (unsigned shift = 0; shift < 32; shift += 8) {
+        const u32 x = ((a >> shift) & 0xFFu) * ((b >> shift) & 0xFFu) + 128u;
+        out |= (((x + (x >> 8)) >> 8) & 0xFFu) << shift;
+    }
+    return out;
+}
+
+inline u32 mul16(u32 a, u32 b) {
+    u32 out = 0;
+    for (unsigned shift = 0; shift < 32; shift += 16) {
+        const std::uint64_t x = static_cast<std::uint64_t>((a >> shift) & 0xFFFFu) * ((b >> shift) & 0xFFFFu) + 32768u;
+        out |= static_cast<u32>(((x + (x >> 16)) >> 16) & 0xFFFFu) << shift;
+    }
+    return out;
+}
+
+// Blend two packed 4x8-bit pixels: each channel becomes (a * (256 - t) + b * t) >> 8.
+// Two channels are processed per 32-bit multiply; 255 * 256 fits a 16-bit lane so
+// no carry crosses into the neighbouring channel.
+inline u32 lerp8x4(u32 a, u32 b, u32 t) {
+    const u32 s = 256u - t;
+    const u32 rb = (((a & 0x00FF00FFu) * s + (b & 0x00FF00FFu) * t) >> 8) & 0x00FF00FFu;
+    const u32 ag = ((((a >> 8) & 0x00FF00FFu) * s + ((b >> 8) & 0x00FF00FFu) * t) >> 8) & 0x00FF00FFu;
+    return rb | (ag << 8);
+}
+
+} // namespace lanes
+
+} // namespace vm32
@@ -0,0 +1,471 @@
+#include "png.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace vm32 {
+
+namespace {
+
+using u8 = std::uint8_t;
+
+void setError(std::string* outError, const std::string& msg) {
+    if (outError) *outError = msg;
+}
+
+// LSB-first bit reader over a deflate stream.
+class BitReader {
+public:
+    BitReader(const u8* data, std::size_t size) : m_data(data), m_size(size) {}
+
+    bool bits(unsigned n, u32& out) {
+        while (m_count < n) {
+            if (m_pos >= m_size) return false;
+            m_buf |= static_cast<std::uint64_t>(m_data[m_pos++]) << m_count;
+            m_count += 8;
+        }
+        out = static_cast<u32>(m_buf & ((std::uint64_t{1} << n) - 1));
+        m_buf >>= n;
+        m_count -= n;
+        return true;
+    }
+
+    // Drops the rest of the current byte; whole bytes still buffered go back.
+    void alignByte() {
+        m_pos -= m_count / 8;
+        m_buf = 0;
+        m_count = 0;
+    }
+
+    const u8* bytes(std::size_t n) { // after alignByte()
+        if (m_size - m_pos < n) return nullptr;
+        const u8* p = m_data + m_pos;
+        m_pos += n;
+        return p;
+    }
+
+    std::size_t pos() const { return m_pos - m_count / 8; } // whole bytes consumed
+
+private:
+    const u8* m_data;
+    std::size_t m_size;
+    std::size_t m_pos{0};
+    std::uint64_t m_buf{0};
+    unsigned m_count{0};
+};
+
+constexpr unsigned MAX_BITS = 15;
+
+// Canonical Huffman code: codes per length and symbols in code order.
+struct Huffman {
+    std::array<std::uint16_t, MAX_BITS + 1> count{};
+    std::array<std::uint16_t, 288> symbol{};
+};
+
+// False for an over-subscribed set of lengths. Incomplete codes are allowed;
+// their unused codes fail in decode().
+bool build(Huffman& h, const u8* lengths, unsigned n) {
+    h.count.fill(0);
+    for (unsigned s = 0; s < n; ++s) ++h.count[lengths[s]];
+    int left = 1;
+    for (unsigned len = 1; len <= MAX_BITS; ++len) {
+        left = (left << 1) - h.count[len];
+        if (left < 0) return false;
+    }
+    std::array<std::uint16_t, MAX_BITS + 1> offs{};
+    for (unsigned len = 1; len < MAX_BITS; ++len) offs[len + 1] = offs[len] + h.count[len];
+    for (unsigned s = 0; s < n; ++s) {
+        if (lengths[s] != 0) h.symbol[offs[lengths[s]]++] = static_cast<std::uint16_t>(s);
+    }
+    return true;
+}
+
+// Next symbol, or -1 at end of input or on an unused code.
+int decode(BitReader& in, const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for (unsigned len = 1; len <= MAX_BITS; ++len) {
+        u32 bit;
+        if (!in.bits(1, bit)) return -1;
+        code |= static_cast<int>(bit);
+        const int count = h.count[len];
+        if (code - count < first) return h.symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+constexpr std::array<std::uint16_t, 29> kLenBase = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr std::array<u8, 29> kLenExtra = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+constexpr std::array<std::uint16_t, 30> kDistBase = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr std::array<u8, 30> kDistExtra = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Literal/length and distance symbols of one block up to end-of-block.
+const char* inflateCodes(BitReader& in, std::vector<u8>& out, std::size_t start, const Huffman& lit, const Huffman& dist) {
+    for (;;) {
+        int sym = decode(in, lit);
+        if (sym < 0) return "Bad literal/length code";
+        if (sym < 256) {
+            out.push_back(static_cast<u8>(sym));
+            continue;
+        }
+        if (sym == 256) return nullptr;
+        sym -= 257;
+        if (sym >= 29) return "Bad length symbol";
+        u32 extra;
+        if (!in.bits(kLenExtra[sym], extra)) return "Truncated deflate data";
+        const std::size_t len = kLenBase[sym] + extra;
+        sym = decode(in, dist);
+        if (sym < 0 || sym >= 30) return "Bad distance code";
+        if (!in.bits(kDistExtra[sym], extra)) return "Truncated deflate data";
+        const std::size_t distance = kDistBase[sym] + extra;
+        if (distance > out.size() - start) return "Distance too far back";
+        const std::size_t from = out.size() - distance;
+        for (std::size_t i = 0; i < len; ++i) out.push_back(out[from + i]); // may overlap
+    }
+}
+
+const char* inflateStored(BitReader& in, std::vector<u8>& out) {
+    in.alignByte();
+    const u8* hdr = in.bytes(4);
+    if (!hdr) return "Truncated stored block";
+    const unsigned len = hdr[0] | (hdr[1] << 8);
+    const unsigned nlen = hdr[2] | (hdr[3] << 8);
+    if (len != (~nlen & 0xFFFFu)) return "Stored block length mismatch";
+    const u8* p = in.bytes(len);
+    if (!p) return "Truncated stored block";
+    out.insert(out.end(), p, p + len);
+    return nullptr;
+}
+
+const char* inflateFixed(BitReader& in, std::vector<u8>& out, std::size_t start) {
+    static const std::array<Huffman, 2> tables = [] {
+        std::array<u8, 288> lengths{};
+        std::fill(lengths.begin(), lengths.begin() + 144, 8);
+        std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+        std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+        std::fill(lengths.begin() + 280, lengths.end(), 8);
+        std::array<Huffman, 2> t;
+        build(t[0], lengths.data(), 288);
+        std::fill(lengths.begin(), lengths.begin() + 30, 5);
+        build(t[1], lengths.data(), 30);
+        return t;
+    }();
+    return inflateCodes(in, out, start, tables[0], tables[1]);
+}
+
+const char* inflateDynamic(BitReader& in, std::vector<u8>& out, std::size_t start) {
+    static constexpr std::array<u8, 19> kOrder = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    u32 nlen, ndist, ncode;
+    if (!in.bits(5, nlen) || !in.bits(5, ndist) || !in.bits(4, ncode)) return "Truncated deflate data";
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30) return "Bad code counts";
+
+    std::array<u8, 320> lengths{};
+    for (u32 i = 0; i < ncode; ++i) {
+        u32 v;
+        if (!in.bits(3, v)) return "Truncated deflate data";
+        lengths[kOrder[i]] = static_cast<u8>(v);
+    }
+    Huffman lencode;
+    if (!build(lencode, lengths.data(), 19)) return "Bad code length code";
+
+    for (u32 i = 0; i < nlen + ndist;) {
+        const int sym = decode(in, lencode);
+        if (sym < 0) return "Bad code length";
+        if (sym < 16) {
+            lengths[i++] = static_cast<u8>(sym);
+            continue;
+        }
+        u8 value = 0;
+        u32 repeat;
+        if (sym == 16) {
+            if (i == 0) return "Repeat with no previous length";
+            value = lengths[i - 1];
+            if (!in.bits(2, repeat)) return "Truncated deflate data";
+            repeat += 3;
+        } else if (sym == 17) {
+            if (!in.bits(3, repeat)) return "Truncated deflate data";
+            repeat += 3;
+        } else {
+            if (!in.bits(7, repeat)) return "Truncated deflate data";
+            repeat += 11;
+        }
+        if (i + repeat > nlen + ndist) return "Too many code lengths";
+        while (repeat--) lengths[i++] = value;
+    }
+    if (lengths[256] == 0) return "No end-of-block code";
+
+    Huffman lit, dist;
+    if (!build(lit, lengths.data(), nlen) || !build(dist, lengths.data() + nlen, ndist)) return "Bad Huffman code";
+    return inflateCodes(in, out, start, lit, dist);
+}
+
+std::array<u32, 256> makeCrcTable() {
+    std::array<u32, 256> t{};
+    for (u32 n = 0; n < 256; ++n) {
+        u32 c = n;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        t[n] = c;
+    }
+    return t;
+}
+
+u32 crc32(const u8* p, std::size_t n) {
+    static const std::array<u32, 256> table = makeCrcTable();
+    u32 c = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < n; ++i) c = table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+u32 be32(const u8* p) {
+    return (static_cast<u32>(p[0]) << 24) | (static_cast<u32>(p[1]) << 16) | (static_cast<u32>(p[2]) << 8) | p[3];
+}
+
+constexpr std::array<u8, 8> kSignature = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+constexpr u32 MAX_PIXELS = 1u << 26;
+
+// Reverses the scanline filters of one (sub)image in place; rows are
+// 1 + stride bytes with the filter type first.
+bool unfilter(u8* data, u32 rows, std::size_t stride, unsigned bpp) {
+    const u8* prev = nullptr;
+    for (u32 y = 0; y < rows; ++y) {
+        u8* row = data + y * (stride + 1);
+        const u8 type = row[0];
+        u8* cur = row + 1;
+        for (std::size_t i = 0; i < stride; ++i) {
+            const int a = i >= bpp ? cur[i - bpp] : 0;
+            const int b = prev ? prev[i] : 0;
+            const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+            int pred;
+            switch (type) {
+                case 0: pred = 0; break;
+                case 1: pred = a; break;
+                case 2: pred = b; break;
+                case 3: pred = (a + b) / 2; break;
+                case 4: {
+                    const int p = a + b - c;
+                    const int pa = p > a ? p - a : a - p;
+                    const int pb = p > b ? p - b : b - p;
+                    const int pc = p > c ? p - c : c - p;
+                    pred = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+                    break;
+                }
+                default: return false;
+            }
+            cur[i] = static_cast<u8>(cur[i] + pred);
+        }
+        prev = cur;
+    }
+    return true;
+}
+
+struct PngInfo {
+    u32 width{0};
+    u32 height{0};
+    unsigned depth{0};
+    unsigned colorType{0};
+    unsigned channels{0};
+    bool interlaced{false};
+    std::array<u32, 256> palette{}; // ARGB
+    bool hasKey{false};             // tRNS colour key (grey or RGB samples)
+    std::array<u32, 3> key{};
+};
+
+u32 sampleAt(const u8* row, u32 index, unsigned depth) {
+    switch (depth) {
+        case 16: return (static_cast<u32>(row[2 * index]) << 8) | row[2 * index + 1];
+        case 8: return row[index];
+        default: {
+            const u32 bit = index * depth;
+            return (row[bit / 8] >> (8 - depth - bit % 8)) & ((1u << depth) - 1);
+        }
+    }
+}
+
+u32 to8(u32 v, unsigned depth) {
+    if (depth == 16) return v >> 8;
+    if (depth == 8) return v;
+    return v * 255 / ((1u << depth) - 1);
+}
+
+u32 pixelAt(const PngInfo& info, const u8* row, u32 x) {
+    u32 s[4];
+    for (unsigned c = 0; c < info.channels; ++c) s[c] = sampleAt(row, x * info.channels + c, info.depth);
+    u32 r, g, b, a = 255;
+    switch (info.colorType) {
+        case 0:
+            r = g = b = to8(s[0], info.depth);
+            if (info.hasKey && s[0] == info.key[0]) a = 0;
+            break;
+        case 2:
+            r = to8(s[0], info.depth); g = to8(s[1], info.depth); b = to8(s[2], info.depth);
+            if (info.hasKey && s[0] == info.key[0] && s[1] == info.key[1] && s[2] == info.key[2]) a = 0;
+            break;
+        case 3:
+            return info.palette[s[0]];
+        case 4:
+            r = g = b = to8(s[0], info.depth);
+            a = to8(s[1], info.depth);
+            break;
+        default:
+            r = to8(s[0], info.depth); g = to8(s[1], info.depth); b = to8(s[2], info.depth);
+            a = to8(s[3], info.depth);
+            break;
+    }
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+} // namespace
+
+bool inflateZlib(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out, std::string* outError) {
+    if (size < 6) { setError(outError, "Truncated zlib stream"); return false; }
+    const unsigned cmf = data[0], flg = data[1];
+    if ((cmf & 0x0F) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 != 0) {
+        setError(outError, "Bad zlib header");
+        return false;
+    }
+    if (flg & 0x20) { setError(outError, "zlib preset dictionaries are not supported"); return false; }
+
+    const std::size_t start = out.size();
+    BitReader in(data + 2, size - 2);
+    for (u32 last = 0; !last;) {
+        u32 type;
+        if (!in.bits(1, last) || !in.bits(2, type)) { setError(outError, "Truncated deflate data"); return false; }
+        const char* err = type == 0 ? inflateStored(in, out)
+                        : type == 1 ? inflateFixed(in, out, start)
+                        : type == 2 ? inflateDynamic(in, out, start)
+                        : "Bad deflate block type";
+        if (err) { setError(outError, err); return false; }
+    }
+
+    const std::size_t end = 2 + in.pos();
+    if (size - end < 4) { setError(outError, "Missing zlib checksum"); return false; }
+    u32 s1 = 1, s2 = 0;
+    for (std::size_t i = start; i < out.size(); ++i) {
+        s1 = (s1 + out[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    if (be32(data + end) != ((s2 << 16) | s1)) { setError(outError, "zlib checksum mismatch"); return false; }
+    return true;
+}
+
+bool isPng(const std::uint8_t* data, std::size_t size) {
+    return size >= kSignature.size() && std::equal(kSignature.begin(), kSignature.end(), data);
+}
+
+bool decodePng(const std::uint8_t* data, std::size_t size, Image& out, std::string* outError) {
+    if (!isPng(data, size)) { setError(outError, "Not a PNG file"); return false; }
+
+    PngInfo info;
+    std::vector<u8> idat;
+    std::size_t paletteSize = 0;
+    bool haveHeader = false, haveEnd = false;
+    for (std::size_t pos = kSignature.size(); !haveEnd;) {
+        if (size - pos < 12) { setError(outError, "Truncated PNG chunk"); return false; }
+        const u32 len = be32(data + pos);
+        if (len > size - pos - 12) { setError(outError, "Truncated PNG chunk"); return false; }
+        const u8* type = data + pos + 4;
+        const u8* body = data + pos + 8;
+        if (crc32(type, len + 4) != be32(body + len)) { setError(outError, "PNG chunk CRC mismatch"); return false; }
+        pos += 12 + len;
+
+        const std::string name(reinterpret_cast<const char*>(type), 4);
+        if (!haveHeader && name != "IHDR") { setError(outError, "PNG does not start with IHDR"); return false; }
+        if (name == "IHDR") {
+            if (haveHeader || len != 13) { setError(outError, "Bad IHDR"); return false; }
+            info.width = be32(body);
+            info.height = be32(body + 4);
+            info.depth = body[8];
+            info.colorType = body[9];
+            static constexpr unsigned kChannels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+            info.channels = info.colorType < 7 ? kChannels[info.colorType] : 0;
+            const unsigned d = info.depth;
+            const bool depthOk = info.colorType == 0 ? (d == 1 || d == 2 || d == 4 || d == 8 || d == 16)
+                               : info.colorType == 3 ? (d == 1 || d == 2 || d == 4 || d == 8)
+                               : (d == 8 || d == 16);
+            if (info.channels == 0 || !depthOk) { setError(outError, "Unsupported PNG colour type or bit depth"); return false; }
+            if (body[10] != 0 || body[11] != 0 || body[12] > 1) {
+                setError(outError, "Unsupported PNG compression, filter or interlace method");
+                return false;
+            }
+            info.interlaced = body[12] == 1;
+            if (info.width == 0 || info.height == 0 || info.width > MAX_PIXELS / info.height) {
+                setError(outError, "PNG dimensions out of range");
+                return false;
+            }
+            haveHeader = true;
+        } else if (name == "PLTE") {
+            if (len % 3 != 0 || len / 3 > 256) { setError(outError, "Bad PLTE"); return false; }
+            paletteSize = len / 3;
+            for (std::size_t i = 0; i < paletteSize; ++i) {
+                info.palette[i] = 0xFF000000u | (static_cast<u32>(body[3 * i]) << 16) |
+                                  (static_cast<u32>(body[3 * i + 1]) << 8) | body[3 * i + 2];
+            }
+        } else if (name == "tRNS") {
+            if (info.colorType == 3) {
+                if (len > paletteSize) { setError(outError, "Bad tRNS"); return false; }
+                for (u32 i = 0; i < len; ++i) info.palette[i] = (info.palette[i] & 0x00FFFFFFu) | (static_cast<u32>(body[i]) << 24);
+            } else if (info.colorType == 0 || info.colorType == 2) {
+                const u32 n = info.colorType == 0 ? 1 : 3;
+                if (len != 2 * n) { setError(outError, "Bad tRNS"); return false; }
+                for (u32 c = 0; c < n; ++c) info.key[c] = (static_cast<u32>(body[2 * c]) << 8) | body[2 * c + 1];
+                info.hasKey = true;
+            }
+        } else if (name == "IDAT") {
+            idat.insert(idat.end(), body, body + len);
+        } else if (name == "IEND") {
+            haveEnd = true;
+        } else if (!(type[0] & 0x20)) {
+            setError(outError, "Unknown critical PNG chunk " + name);
+            return false;
+        }
+    }
+    if (info.colorType == 3 && paletteSize == 0) { setError(outError, "Palette PNG without PLTE"); return false; }
+
+    std::vector<u8> raw;
+    if (!inflateZlib(idat.data(), idat.size(), raw, outError)) return false;
+
+    // Adam7 passes (x0, y0, dx, dy); a plain image is one pass over everything.
+    static constexpr u32 kAdam7[7][4] = {
+        { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+    static constexpr u32 kPlain[1][4] = { { 0, 0, 1, 1 } };
+    const auto& passes = info.interlaced ? kAdam7 : kPlain;
+    const unsigned passCount = info.interlaced ? 7 : 1;
+    const unsigned bitsPerPixel = info.channels * info.depth;
+    const unsigned bpp = std::max(1u, bitsPerPixel / 8);
+
+    out.width = info.width;
+    out.height = info.height;
+    out.cells.assign(static_cast<std::size_t>(info.width) * info.height, 0);
+    std::size_t offset = 0;
+    for (unsigned p = 0; p < passCount; ++p) {
+        const u32 x0 = passes[p][0], y0 = passes[p][1], dx = passes[p][2], dy = passes[p][3];
+        if (x0 >= info.width || y0 >= info.height) continue;
+        const u32 cols = (info.width - x0 + dx - 1) / dx;
+        const u32 rows = (info.height - y0 + dy - 1) / dy;
+        const std::size_t stride = (static_cast<std::size_t>(cols) * bitsPerPixel + 7) / 8;
+        const std::size_t bytes = rows * (stride + 1);
+        if (raw.size() - offset < bytes) { setError(outError, "PNG image data too short"); return false; }
+        u8* sub = raw.data() + offset;
+        if (!unfilter(sub, rows, stride, bpp)) { setError(outError, "Bad PNG filter type"); return false; }
+        for (u32 y = 0; y < rows; ++y) {
+            const u8* row = sub + y * (stride + 1) + 1;
+            i32* dst = out.cells.data() + static_cast<std::size_t>(y0 + y * dy) * info.width;
+            for (u32 x = 0; x < cols; ++x) dst[x0 + x * dx] = static_cast<i32>(pixelAt(info, row, x));
+        }
+        offset += bytes;
+    }
+    return true;
+}
+
+} // namespace vm32
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// Image as VM cells: one ARGB8888 pixel per cell (the framebuffer format),
+// rows top to bottom.
+struct Image {
+    u32 width{0};
+    u32 height{0};
+    std::vector<i32> cells;
+};
+
+// Decompresses a zlib stream (RFC 1950 around RFC 1951 deflate data),
+// appending to out. The Adler-32 checksum is verified.
+bool inflateZlib(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out, std::string* outError = nullptr);
+
+bool isPng(const std::uint8_t* data, std::size_t size); // by signature
+
+// Decodes a PNG of any standard colour type and bit depth, interlaced or not.
+// tRNS transparency is applied and 16-bit samples keep their high byte; other
+// ancillary chunks (gamma, colour profiles, text) are ignored.
+bool decodePng(const std::uint8_t* data, std::size_t size, Image& out, std::string* outError = nullptr);
+
+} // namespace vm32
@@ -0,0 +1,80 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+namespace vm32 {
+
+namespace {
+
+std::string hexAddr(u32 addr) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "0x%04x", addr);
+    return buf;
+}
+
+std::string functionName(const LineMap* map, u32 ip) {
+    const LineMap::Function* fn = map ? map->functionAt(ip) : nullptr;
+    return fn ? fn->name : hexAddr(ip);
+}
+
+std::string lineName(const LineMap* map, u32 ip) {
+    const u32 line = map ? map->lineAt(ip) : 0;
+    if (line == 0) return hexAddr(ip);
+    const std::string src = map->source.empty() ? "line" : map->source;
+    return src + ":" + std::to_string(line) + " (" + functionName(map, ip) + ")";
+}
+
+void writeTable(std::FILE* out, const char* title, const std::map<std::string, std::uint64_t>& counts,
+                std::uint64_t total, std::size_t maxRows) {
+    std::vector<std::pair<std::string, std::uint64_t>> rows(counts.begin(), counts.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    std::fprintf(out, "  %10s  %6s  %s\n", "samples", "%", title);
+    for (std::size_t i = 0; i < rows.size() && i < maxRows; ++i) {
+        std::fprintf(out, "  %10llu  %6.2f  %s\n", static_cast<unsigned long long>(rows[i].second),
+                     100.0 * static_cast<double>(rows[i].second) / static_cast<double>(total), rows[i].first.c_str());
+    }
+}
+
+} // namespace
+
+void writeProfileReport(std::FILE* out, const std::vector<ProfileSample>& samples, u32 intervalSteps,
+                        const LineMap* map, std::size_t maxRows) {
+    std::uint64_t total = 0;
+    std::map<std::string, std::uint64_t> byFunction, byLine;
+    for (const ProfileSample& s : samples) {
+        total += s.count;
+        byFunction[functionName(map, s.ip)] += s.count;
+        byLine[lineName(map, s.ip)] += s.count;
+    }
+    std::fprintf(out, "profile: %llu samples, one every %u instructions\n", static_cast<unsigned long long>(total), intervalSteps);
+    if (total == 0) return;
+    writeTable(out, "function", byFunction, total, maxRows);
+    writeTable(out, "line", byLine, total, maxRows);
+}
+
+bool writeCollapsedStacks(const std::string& path, const std::vector<ProfileSample>& samples,
+                          const LineMap* map, std::string* outError) {
+    std::map<std::string, std::uint64_t> stacks;
+    for (const ProfileSample& s : samples) {
+        std::string stack = s.inIrq ? functionName(map, s.irqFrom) + ";" : std::string();
+        stacks[stack + functionName(map, s.ip)] += s.count;
+    }
+
+    std::FILE* f = std::fopen(path.c_str(), "w");
+    if (!f) {
+        if (outError) *outError = "Failed to open for write: " + path;
+        return false;
+    }
+    for (const auto& kv : stacks) {
+        std::fprintf(f, "%s %llu\n", kv.first.c_str(), static_cast<unsigned long long>(kv.second));
+    }
+    if (std::fclose(f) != 0) {
+        if (outError) *outError = "Failed to write collapsed stacks: " + path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace vm32
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "vm.h"
+#include "../bytecode/line_map.h"
+
+namespace vm32 {
+
+// Reports for VM::profileSamples(). Samples are resolved through `map` when
+// given; without one, functions and lines fall back to code addresses.
+
+// Per-function and per-source-line tables, hottest first, at most `maxRows` each.
+void writeProfileReport(std::FILE* out, const std::vector<ProfileSample>& samples, u32 intervalSteps,
+                        const LineMap* map, std::size_t maxRows = 20);
+
+// Collapsed stacks ("outer;inner count" per line) for flamegraph.pl and
+// compatible viewers. A sample inside an interrupt handler is stacked on the
+// function it interrupted.
+bool writeCollapsedStacks(const std::string& path, const std::vector<ProfileSample>& samples,
+                          const LineMap* map, std::string* outError = nullptr);
+
+} // namespace vm32
@@ -0,0 +1,472 @@
+#include "register_ir.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "packed_lanes.h"
+#include "translate_common.h"
+#include "vm.h"
+
+namespace vm32 {
+
+class RegisterTranslator {
+public:
+    explicit RegisterTranslator(RegisterProgram& p) : m_p(p) {}
+
+    // Translates the block of instructions [first, last); `exit` is the address
+    // of a handed-back instruction that ends it, or ~0u.
+    void block(const std::vector<DecodedInsn>& insns, std::size_t first, std::size_t last, u32 exit);
+
+private:
+    using RegOp = RegisterProgram::RegOp;
+
+    struct Val {
+        bool isConst;
+        i32 v; // register index unless isConst
+    };
+    struct Stack {
+        std::vector<Val> vals; // values above the memory stack, bottom first
+        int depth{0};          // memory stack cells relative to the entry sp
+    };
+
+    void emit(RegOp op, u8 d = 0, u8 a = 0, u8 b = 0, u32 x = 0, u32 y = 0) { m_p.m_code.push_back({ op, d, a, b, x, y }); }
+
+    bool used(u32 r) const {
+        if (m_pinned & (1u << r)) return true;
+        for (const Val& v : m_stack.vals) if (!v.isConst && static_cast<u32>(v.v) == r) return true;
+        for (const Val& v : m_before.vals) if (!v.isConst && static_cast<u32>(v.v) == r) return true;
+        return false;
+    }
+    u32 freeRegisters() const {
+        u32 n = 0;
+        for (u32 r = 0; r < RegisterProgram::REGISTERS; ++r) n += used(r) ? 0 : 1;
+        return n;
+    }
+    u8 alloc() {
+        u32 r = 0;
+        while (used(r)) ++r; // reserve() leaves enough free for any one instruction
+        m_pinned |= 1u << r;
+        return static_cast<u8>(r);
+    }
+    // Store every value to the memory stack, freeing all registers.
+    void flush() {
+        for (const Val& v : m_stack.vals) {
+            if (v.isConst) emit(RegOp::STSI, 0, 0, 0, static_cast<u32>(m_stack.depth), static_cast<u32>(v.v));
+            else emit(RegOp::STS, 0, static_cast<u8>(v.v), 0, static_cast<u32>(m_stack.depth));
+            ++m_stack.depth;
+        }
+        m_stack.vals.clear();
+    }
+    Val pop() {
+        if (!m_stack.vals.empty()) {
+            const Val v = m_stack.vals.back();
+            m_stack.vals.pop_back();
+            if (!v.isConst) m_pinned |= 1u << v.v;
+            return v;
+        }
+        const u8 r = alloc();
+        emit(RegOp::LDS, r, 0, 0, static_cast<u32>(--m_stack.depth));
+        return { false, r };
+    }
+    u8 reg(Val v) {
+        if (!v.isConst) return static_cast<u8>(v.v);
+        const u8 r = alloc();
+        emit(RegOp::MOVI, r, 0, 0, static_cast<u32>(v.v));
+        return r;
+    }
+    void push(Val v) { m_stack.vals.push_back(v); }
+    void pushReg(u8 r) { m_stack.vals.push_back({ false, r }); }
+
+    u32 exitRecord(const Stack& st, u32 ip, u32 unexecuted, bool stop) {
+        RegisterProgram::Exit e{ ip, unexecuted, static_cast<u32>(m_p.m_spills.size()),
+                                 static_cast<u32>(st.vals.size()), st.depth + static_cast<i32>(st.vals.size()), stop };
+        for (std::size_t i = 0; i < st.vals.size(); ++i) {
+            m_p.m_spills.push_back({ st.depth + static_cast<i32>(i), st.vals[i].v, st.vals[i].isConst });
+        }
+        m_p.m_exits.push_back(e);
+        return static_cast<u32>(m_p.m_exits.size() - 1);
+    }
+    // Leave before `in` with the stack as it was before it.
+    u32 fallback(const DecodedInsn& in) { return exitRecord(m_before, in.addr, m_remaining, true); }
+
+    void insn(const DecodedInsn& in, bool last);
+
+    RegisterProgram& m_p;
+    Stack m_stack;
+    Stack m_before;
+    u32 m_pinned{0};    // registers the current instruction reads or writes
+    u32 m_remaining{0}; // instructions of the block not yet run, including the current one
+};
+
+void RegisterTranslator::block(const std::vector<DecodedInsn>& insns, std::size_t first, std::size_t last, u32 exit) {
+    int lowest, highest;
+    stackBounds(insns, first, last, lowest, highest);
+    m_p.m_blockAt[insns[first].addr] = static_cast<u32>(m_p.m_blocks.size());
+    m_p.m_blocks.push_back({ static_cast<u32>(m_p.m_code.size()), static_cast<u32>(last - first),
+                             static_cast<u32>(-lowest), static_cast<u32>(highest) });
+
+    m_stack = Stack{};
+    for (std::size_t i = first; i < last; ++i) {
+        m_remaining = static_cast<u32>(last - i);
+        insn(insns[i], i + 1 == last && exit == ~0u);
+    }
+    if (exit != ~0u) emit(RegOp::EXIT, 0, 0, 0, exitRecord(m_stack, exit, 0, true));
+}
+
+void RegisterTranslator::insn(const DecodedInsn& in, bool last) {
+    m_pinned = 0;
+    m_before = Stack{};
+    if (freeRegisters() < 4) flush();
+    m_before = m_stack;
+
+    Val a, b, c;
+    u8 d;
+    switch (in.op) {
+        case Op::PUSHI: push({ true, static_cast<i32>(in.a) }); break;
+        case Op::POP:
+            if (m_stack.vals.empty()) --m_stack.depth;
+            else m_stack.vals.pop_back();
+            break;
+        case Op::DUP: a = pop(); push(a); push(a); break;
+        case Op::SWAP: b = pop(); a = pop(); push(b); push(a); break;
+        case Op::OVER: b = pop(); a = pop(); push(a); push(b); push(a); break;
+
+        case Op::ADD: case Op::SUB: case Op::MUL: case Op::AND: case Op::OR: case Op::XOR:
+        case Op::SHL: case Op::SHR: case Op::SAR:
+        case Op::CMP_EQ: case Op::CMP_LT: case Op::CMP_GT: case Op::CMP_LTU: {
+            RegOp rr = RegOp::ADD, ri = RegOp::ADDI;
+            switch (in.op) {
+                case Op::SUB: rr = RegOp::SUB; ri = RegOp::SUBI; break;
+                case Op::MUL: rr = RegOp::MUL; ri = RegOp::MULI; break;
+                case Op::AND: rr = RegOp::AND; ri = RegOp::ANDI; break;
+                case Op::OR:  rr = RegOp::OR;  ri = RegOp::ORI;  break;
+                case Op::XOR: rr = RegOp::XOR; ri = RegOp::XORI; break;
+                case Op::SHL: rr = RegOp::SHL; ri = RegOp::SHLI; break;
+                case Op::SHR: rr = RegOp::SHR; ri = RegOp::SHRI; break;
+                case Op::SAR: rr = RegOp::SAR; ri = RegOp::SARI; break;
+                case Op::CMP_EQ:  rr = RegOp::CMP_EQ;  ri = RegOp::CMP_EQI;  break;
+                case Op::CMP_LT:  rr = RegOp::CMP_LT;  ri = RegOp::CMP_LTI;  break;
+                case Op::CMP_GT:  rr = RegOp::CMP_GT;  ri = RegOp::CMP_GTI;  break;
+                case Op::CMP_LTU: rr = RegOp::CMP_LTU; ri = RegOp::CMP_LTUI; break;
+                default: break;
+            }
+            b = pop();
+            a = pop();
+            const u8 ra = reg(a);
+            if (b.isConst) {
+                d = alloc();
+                emit(ri, d, ra, 0, 0, static_cast<u32>(b.v));
+            } else {
+                d = alloc();
+                emit(rr, d, ra, static_cast<u8>(b.v));
+            }
+            pushReg(d);
+            break;
+        }
+        case Op::DIV: case Op::MOD: case Op::DIVU: case Op::MODU: case Op::FXDIV: case Op::FB_XY: {
+            const RegOp op = in.op == Op::DIV ? RegOp::DIV : in.op == Op::MOD ? RegOp::MOD : in.op == Op::DIVU ? RegOp::DIVU
+                           : in.op == Op::MODU ? RegOp::MODU : in.op == Op::FXDIV ? RegOp::FXDIV : RegOp::FB_XY;
+            b = pop();
+            a = pop();
+            const u8 ra = reg(a), rb = reg(b);
+            const u32 x = fallback(in);
+            d = alloc();
+            emit(op, d, ra, rb, x);
+            pushReg(d);
+            break;
+        }
+        case Op::NEG: case Op::NOT: case Op::FNEG: case Op::FSQRT: case Op::ITOF: case Op::FTOI: {
+            const RegOp op = in.op == Op::NEG ? RegOp::NEG : in.op == Op::NOT ? RegOp::NOT : in.op == Op::FNEG ? RegOp::FNEG
+                           : in.op == Op::FSQRT ? RegOp::FSQRT : in.op == Op::ITOF ? RegOp::ITOF : RegOp::FTOI;
+            const u8 ra = reg(pop());
+            d = alloc();
+            emit(op, d, ra);
+            pushReg(d);
+            break;
+        }
+        case Op::FADD: case Op::FSUB: case Op::FMUL: case Op::FDIV: case Op::FCMP: case Op::FXMUL: {
+            const RegOp op = in.op == Op::FADD ? RegOp::FADD : in.op == Op::FSUB ? RegOp::FSUB : in.op == Op::FMUL ? RegOp::FMUL
+                           : in.op == Op::FDIV ? RegOp::FDIV : in.op == Op::FCMP ? RegOp::FCMP : RegOp::FXMUL;
+            b = pop();
+            a = pop();
+            const u8 ra = reg(a), rb = reg(b);
+            d = alloc();
+            emit(op, d, ra, rb);
+            pushReg(d);
+            break;
+        }
+        case Op::VADD8: case Op::VADDS8: case Op::VSUBS8: case Op::VMUL8:
+        case Op::VMIN8: case Op::VMAX8: case Op::VAVG8:
+        case Op::VADD16: case Op::VADDS16: case Op::VSUBS16: case Op::VMUL16:
+        case Op::VMIN16: case Op::VMAX16: case Op::VAVG16: {
+            b = pop();
+            a = pop();
+            const u8 ra = reg(a), rb = reg(b);
+            d = alloc();
+            emit(RegOp::PACKED, d, ra, rb, static_cast<u32>(in.op));
+            pushReg(d);
+            break;
+        }
+        case Op::LERP8X4: {
+            c = pop();
+            b = pop();
+            a = pop();
+            const u8 ra = reg(a), rb = reg(b), rc = reg(c);
+            d = alloc();
+            emit(RegOp::LERP, d, ra, rb, 0, rc);
+            pushReg(d);
+            break;
+        }
+
+        case Op::LOAD:
+            d = alloc();
+            emit(RegOp::LD, d, 0, 0, in.a);
+            pushReg(d);
+            break;
+        case Op::STORE:
+            a = pop();
+            if (a.isConst) emit(RegOp::STI, 0, 0, 0, in.a, static_cast<u32>(a.v));
+            else emit(RegOp::ST, 0, static_cast<u8>(a.v), 0, in.a);
+            break;
+        case Op::LOAD_IND:
+        case Op::LOAD_IDX: {
+            const u8 ra = reg(pop());
+            const u32 x = fallback(in);
+            d = alloc();
+            emit(RegOp::LDX, d, ra, 0, x, in.op == Op::LOAD_IDX ? in.a : 0);
+            pushReg(d);
+            break;
+        }
+        case Op::STORE_IND:
+        case Op::STORE_IDX: {
+            b = pop();
+            a = pop();
+            const u8 ra = reg(a), rb = reg(b);
+            emit(RegOp::STX, 0, ra, rb, fallback(in), in.op == Op::STORE_IDX ? in.a : 0);
+            break;
+        }
+
+        case Op::JMP:
+            emit(RegOp::EXIT, 0, 0, 0, exitRecord(m_stack, in.a, 0, false));
+            return;
+        case Op::JZ: case Op::JNZ:
+        case Op::JEQ: case Op::JNE: case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+        case Op::JEQ_IMM: case Op::JNE_IMM: case Op::JLT_IMM: case Op::JLE_IMM: case Op::JGT_IMM: case Op::JGE_IMM: {
+            const bool imm = in.op >= Op::JEQ_IMM && in.op <= Op::JGE_IMM;
+            const u32 target = imm ? in.b : in.a;
+            u8 ra = 0, rb = 0;
+            if (in.op == Op::JZ || in.op == Op::JNZ || imm) {
+                ra = reg(pop());
+            } else {
+                b = pop();
+                a = pop();
+                ra = reg(a);
+                rb = reg(b);
+            }
+            // Taken and not-taken exits are consecutive.
+            const u32 x = target < VM::MEM_SIZE ? exitRecord(m_stack, target, 0, false) : fallback(in);
+            exitRecord(m_stack, in.next, 0, false);
+            // JZ..JGE_IMM map onto BZ..BGEI in order.
+            const RegOp op = static_cast<RegOp>(static_cast<u32>(RegOp::BZ) + static_cast<u32>(in.op) - static_cast<u32>(Op::JZ));
+            emit(op, 0, ra, rb, x, imm ? in.a : 0);
+            return;
+        }
+        default:
+            break;
+    }
+    if (last) emit(RegOp::EXIT, 0, 0, 0, exitRecord(m_stack, in.next, 0, false));
+}
+
+RegisterProgram::RegisterProgram(const u32* code, std::size_t count) {
+    std::vector<DecodedInsn> insns;
+    std::vector<TranslationPiece> pieces;
+    m_blockAt.assign(decodePieces(code, count, insns, pieces), NO_BLOCK);
+
+    // Blocks are basic blocks, cut after each handed-back instruction.
+    RegisterTranslator translator(*this);
+    for (const TranslationPiece& p : pieces) {
+        if (p.first < p.last) translator.block(insns, p.first, p.last, p.exit);
+    }
+}
+
+int RegisterProgram::run(LjAotState& s) const {
+    i32* const mem = s.mem;
+    i32 r[REGISTERS] = {};
+    u32 ip = s.ip;
+    u32 sp = s.sp;
+    std::uint64_t steps = 0;
+    int status = LJ_AOT_FALLBACK;
+    for (;;) {
+        if (ip >= m_blockAt.size() || m_blockAt[ip] == NO_BLOCK) break;
+        const Block& blk = m_blocks[m_blockAt[ip]];
+        if (s.budget - steps < blk.count) { status = LJ_AOT_BUDGET; break; }
+        if (sp - s.stackLo < blk.need || s.stackHi - sp < blk.grow) break;
+        steps += blk.count;
+
+        u32 e = 0;
+        for (const Insn* in = &m_code[blk.first];; ++in) {
+            const i32 a = r[in->a];
+            const i32 b = r[in->b];
+            const u32 ua = static_cast<u32>(a);
+            const u32 ub = static_cast<u32>(b);
+            const u32 y = in->y;
+            i32& d = r[in->d];
+            switch (in->op) {
+                case RegOp::MOVI: d = static_cast<i32>(in->x); break;
+                case RegOp::LDS:  d = mem[sp + in->x]; break;
+                case RegOp::STS:  mem[sp + in->x] = a; break;
+                case RegOp::STSI: mem[sp + in->x] = static_cast<i32>(y); break;
+                case RegOp::LD:   d = mem[in->x]; break;
+                case RegOp::ST:   mem[in->x] = a; break;
+                case RegOp::STI:  mem[in->x] = static_cast<i32>(y); break;
+                case RegOp::LDX: {
+                    const u32 addr = y + ua;
+                    if (addr >= VM::MEM_SIZE || addr == VM::CORE_ID_ADDR) { e = in->x; goto leave; }
+                    d = mem[addr];
+                    break;
+                }
+                case RegOp::STX: {
+                    const u32 addr = y + ub;
+                    if (addr >= VM::MEM_SIZE || addr == VM::BARRIER_ADDR || addr == VM::IRQ_ENABLE_ADDR || addr == VM::DMA_CTRL_ADDR) {
+                        e = in->x;
+                        goto leave;
+                    }
+                    mem[addr] = a;
+                    break;
+                }
+
+                case RegOp::ADD: d = static_cast<i32>(ua + ub); break;
+                case RegOp::SUB: d = static_cast<i32>(ua - ub); break;
+                case RegOp::MUL: d = static_cast<i32>(ua * ub); break;
+                case RegOp::AND: d = a & b; break;
+                case RegOp::OR:  d = a | b; break;
+                case RegOp::XOR: d = a ^ b; break;
+                case RegOp::SHL: d = static_cast<i32>(ua << (ub & 31u)); break;
+                case RegOp::SHR: d = static_cast<i32>(ua >> (ub & 31u)); break;
+                case RegOp::SAR: d = a >> (ub & 31u); break;
+                case RegOp::CMP_EQ:  d = a == b; break;
+                case RegOp::CMP_LT:  d = a < b; break;
+                case RegOp::CMP_GT:  d = a > b; break;
+                case RegOp::CMP_LTU: d = ua < ub; break;
+                case RegOp::ADDI: d = static_cast<i32>(ua + y); break;
+                case RegOp::SUBI: d = static_cast<i32>(ua - y); break;
+                case RegOp::MULI: d = static_cast<i32>(ua * y); break;
+                case RegOp::ANDI: d = static_cast<i32>(ua & y); break;
+                case RegOp::ORI:  d = static_cast<i32>(ua | y); break;
+                case RegOp::XORI: d = static_cast<i32>(ua ^ y); break;
+                case RegOp::SHLI: d = static_cast<i32>(ua << (y & 31u)); break;
+                case RegOp::SHRI: d = static_cast<i32>(ua >> (y & 31u)); break;
+                case RegOp::SARI: d = a >> (y & 31u); break;
+                case RegOp::CMP_EQI:  d = a == static_cast<i32>(y); break;
+                case RegOp::CMP_LTI:  d = a < static_cast<i32>(y); break;
+                case RegOp::CMP_GTI:  d = a > static_cast<i32>(y); break;
+                case RegOp::CMP_LTUI: d = ua < y; break;
+
+                case RegOp::DIV:
+                case RegOp::MOD:
+                    if (b == 0 || (a == INT32_MIN && b == -1)) { e = in->x; goto leave; }
+                    d = in->op == RegOp::DIV ? a / b : a % b;
+                    break;
+                case RegOp::DIVU:
+                case RegOp::MODU:
+                    if (ub == 0) { e = in->x; goto leave; }
+                    d = static_cast<i32>(in->op == RegOp::DIVU ? ua / ub : ua % ub);
+                    break;
+                case RegOp::FXDIV:
+                    if (b == 0) { e = in->x; goto leave; }
+                    d = static_cast<i32>(static_cast<u32>((static_cast<std::int64_t>(a) * 65536) / b));
+                    break;
+
+                case RegOp::NEG:   d = static_cast<i32>(0u - ua); break;
+                case RegOp::NOT:   d = ~a; break;
+                case RegOp::FNEG:  d = a ^ static_cast<i32>(0x80000000u); break;
+                case RegOp::FSQRT: d = f32ToCell(std::sqrt(cellToF32(a))); break;
+                case RegOp::ITOF:  d = f32ToCell(static_cast<float>(a)); break;
+                case RegOp::FTOI: {
+                    const float f = cellToF32(a);
+                    if (std::isnan(f)) d = 0;
+                    else if (f >= 2147483648.0f) d = 0x7FFFFFFF;
+                    else if (f <= -2147483648.0f) d = static_cast<i32>(0x80000000u);
+                    else d = static_cast<i32>(f);
+                    break;
+                }
+                case RegOp::FADD: d = f32ToCell(cellToF32(a) + cellToF32(b)); break;
+                case RegOp::FSUB: d = f32ToCell(cellToF32(a) - cellToF32(b)); break;
+                case RegOp::FMUL: d = f32ToCell(cellToF32(a) * cellToF32(b)); break;
+                case RegOp::FDIV: d = f32ToCell(cellToF32(a) / cellToF32(b)); break;
+                case RegOp::FCMP: {
+                    const float fa = cellToF32(a), fb = cellToF32(b);
+                    d = (fa < fb) ? -1 : (fa > fb) ? 1 : (fa == fb) ? 0 : 2;
+                    break;
+                }
+                case RegOp::FXMUL:
+                    d = static_cast<i32>(static_cast<u32>((static_cast<std::int64_t>(a) * b) >> 16));
+                    break;
+
+                case RegOp::PACKED: {
+                    u32 res = 0;
+                    switch (static_cast<Op>(in->x)) {
+                        case Op::VADD8:   res = lanes::add<8>(ua, ub); break;
+                        case Op::VADDS8:  res = lanes::addSat<8>(ua, ub); break;
+                        case Op::VSUBS8:  res = lanes::subSat<8>(ua, ub); break;
+                        case Op::VMUL8:   res = lanes::mul8(ua, ub); break;
+                        case Op::VMIN8:   res = lanes::min<8>(ua, ub); break;
+                        case Op::VMAX8:   res = lanes::max<8>(ua, ub); break;
+                        case Op::VAVG8:   res = lanes::avg<8>(ua, ub); break;
+                        case Op::VADD16:  res = lanes::add<16>(ua, ub); break;
+                        case Op::VADDS16: res = lanes::addSat<16>(ua, ub); break;
+                        case Op::VSUBS16: res = lanes::subSat<16>(ua, ub); break;
+                        case Op::VMUL16:  res = lanes::mul16(ua, ub); break;
+                        case Op::VMIN16:  res = lanes::min<16>(ua, ub); break;
+                        case Op::VMAX16:  res = lanes::max<16>(ua, ub); break;
+                        case Op::VAVG16:  res = lanes::avg<16>(ua, ub); break;
+                        default: break;
+                    }
+                    d = static_cast<i32>(res);
+                    break;
+                }
+                case RegOp::LERP: {
+                    const i32 t = r[y];
+                    d = static_cast<i32>(lanes::lerp8x4(ua, ub, static_cast<u32>(t < 0 ? 0 : (t > 256 ? 256 : t))));
+                    break;
+                }
+                case RegOp::FB_XY:
+                    if (ua >= VM::FB_WIDTH || ub >= VM::FB_HEIGHT) { e = in->x; goto leave; }
+                    d = static_cast<i32>(VM::FB_BASE + ub * VM::FB_WIDTH + ua);
+                    break;
+
+                case RegOp::BZ:   e = in->x + (a == 0 ? 0 : 1); goto leave;
+                case RegOp::BNZ:  e = in->x + (a != 0 ? 0 : 1); goto leave;
+                case RegOp::BEQ:  e = in->x + (a == b ? 0 : 1); goto leave;
+                case RegOp::BNE:  e = in->x + (a != b ? 0 : 1); goto leave;
+                case RegOp::BLT:  e = in->x + (a < b ? 0 : 1); goto leave;
+                case RegOp::BLE:  e = in->x + (a <= b ? 0 : 1); goto leave;
+                case RegOp::BGT:  e = in->x + (a > b ? 0 : 1); goto leave;
+                case RegOp::BGE:  e = in->x + (a >= b ? 0 : 1); goto leave;
+                case RegOp::BEQI: e = in->x + (a == static_cast<i32>(y) ? 0 : 1); goto leave;
+                case RegOp::BNEI: e = in->x + (a != static_cast<i32>(y) ? 0 : 1); goto leave;
+                case RegOp::BLTI: e = in->x + (a < static_cast<i32>(y) ? 0 : 1); goto leave;
+                case RegOp::BLEI: e = in->x + (a <= static_cast<i32>(y) ? 0 : 1); goto leave;
+                case RegOp::BGTI: e = in->x + (a > static_cast<i32>(y) ? 0 : 1); goto leave;
+                case RegOp::BGEI: e = in->x + (a >= static_cast<i32>(y) ? 0 : 1); goto leave;
+                case RegOp::EXIT: e = in->x; goto leave;
+            }
+        }
+    leave:
+        const Exit& ex = m_exits[e];
+        for (u32 i = 0; i < ex.spillCount; ++i) {
+            const Spill& sv = m_spills[ex.spillFirst + i];
+            mem[sp + static_cast<u32>(sv.offset)] = sv.isConst ? sv.value : r[sv.value];
+        }
+        sp += static_cast<u32>(ex.spDelta);
+        steps -= ex.unexecuted;
+        ip = ex.ip;
+        if (ex.stop) break;
+    }
+    s.ip = ip;
+    s.sp = sp;
+    s.steps = steps;
+    return status;
+}
+
+} // namespace vm32
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "aot_abi.h"
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// Three-address form of a loaded program, built by VM::load() when register
+// IR is on (see VM::setRegisterIr()). Basic blocks are translated the way the
+// aot tool translates them: values a block pushes live in a fixed file of
+// REGISTERS virtual registers instead of memory, constants become immediate
+// operands, and the stack in memory is only read for values the block did
+// not push and written once, when the block exits. A block ends by leaving
+// through an exit record, which stores its remaining values, moves sp and
+// names the next ip.
+//
+// run() has the contract of a native module's run() (aot_abi.h): it starts
+// at an entry address and hands back PRINT, SYSCALL, HALT, interrupts,
+// threads, atomics, heap operations, device registers and anything that
+// would fault, before executing it.
+class RegisterProgram {
+public:
+    static constexpr u32 REGISTERS = 16;
+
+    RegisterProgram(const u32* code, std::size_t count);
+
+    bool isEntry(u32 ip) const { return ip < m_blockAt.size() && m_blockAt[ip] != NO_BLOCK; }
+    int run(LjAotState& state) const;
+
+    std::size_t blockCount() const { return m_blocks.size(); }
+    std::size_t insnCount() const { return m_code.size(); } // register instructions, exits included
+
+private:
+    friend class RegisterTranslator;
+
+    enum class RegOp : u8 {
+        MOVI, LDS, STS, STSI, LD, ST, STI, LDX, STX,
+        ADD, SUB, MUL, AND, OR, XOR, SHL, SHR, SAR, CMP_EQ, CMP_LT, CMP_GT, CMP_LTU,
+        ADDI, SUBI, MULI, ANDI, ORI, XORI, SHLI, SHRI, SARI, CMP_EQI, CMP_LTI, CMP_GTI, CMP_LTUI,
+        DIV, MOD, DIVU, MODU, FXDIV,
+        NEG, NOT, FNEG, FSQRT, ITOF, FTOI,
+        FADD, FSUB, FMUL, FDIV, FCMP, FXMUL,
+        PACKED, LERP, FB_XY,
+        BZ, BNZ, BEQ, BNE, BLT, BLE, BGT, BGE, BEQI, BNEI, BLTI, BLEI, BGTI, BGEI, EXIT
+    };
+
+    // d = destination, a/b = source registers. x and y by op:
+    //   MOVI imm | LDS/STS/STSI offset from the block's entry sp (STSI: y = imm)
+    //   LD/ST addr | STI addr, y = imm | LDX/STX exit, y = base (STX: a = value, b = addr)
+    //   *I y = imm | checked ops and FB_XY: x = fallback exit | PACKED x = the Op
+    //   LERP y = third register | B* x = exit if taken (x + 1 if not), B*I y = imm
+    //   EXIT x = exit
+    struct Insn {
+        RegOp op;
+        u8 d{0};
+        u8 a{0};
+        u8 b{0};
+        u32 x{0};
+        u32 y{0};
+    };
+
+    struct Block {
+        u32 first; // index into m_code
+        u32 count; // bytecode instructions
+        u32 need;  // stack cells read below the entry sp
+        u32 grow;  // stack cells written above it
+    };
+
+    struct Spill {
+        i32 offset;
+        i32 value; // register index unless isConst
+        bool isConst;
+    };
+
+    struct Exit {
+        u32 ip;
+        u32 unexecuted; // instructions of the block charged but not run
+        u32 spillFirst;
+        u32 spillCount;
+        i32 spDelta;
+        bool stop;      // hand ip to the interpreter even if it starts a block
+    };
+
+    static constexpr u32 NO_BLOCK = 0xFFFFFFFFu;
+
+    std::vector<Insn> m_code;
+    std::vector<Block> m_blocks;
+    std::vector<u32> m_blockAt; // per code cell
+    std::vector<Exit> m_exits;
+    std::vector<Spill> m_spills;
+};
+
+} // namespace vm32
@@ -0,0 +1,176 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace vm32 {
+
+namespace {
+
+constexpr std::array<std::uint8_t, 8> kMagic = { 'L','J','S','S','\r','\n',0x1A,'\n' };
+constexpr u32 kVersion = 1;
+constexpr u32 kFlagRle = 1u << 0;
+constexpr u32 kRunBit = 0x80000000u;
+constexpr u32 kMinRun = 3; // shorter runs are cheaper as literals
+
+void setError(std::string* outError, const std::string& msg) {
+    if (outError) *outError = msg;
+}
+
+void putU32LE(std::vector<std::uint8_t>& out, u32 v) {
+    out.push_back(static_cast<std::uint8_t>(v & 0xFF));
+    out.push_back(static_cast<std::uint8_t>((v >> 8) & 0xFF));
+    out.push_back(static_cast<std::uint8_t>((v >> 16) & 0xFF));
+    out.push_back(static_cast<std::uint8_t>((v >> 24) & 0xFF));
+}
+
+bool getU32LE(const std::vector<std::uint8_t>& in, std::size_t& pos, u32& out) {
+    if (in.size() - pos < 4) return false;
+    out = static_cast<u32>(in[pos]) |
+          (static_cast<u32>(in[pos + 1]) << 8) |
+          (static_cast<u32>(in[pos + 2]) << 16) |
+          (static_cast<u32>(in[pos + 3]) << 24);
+    pos += 4;
+    return true;
+}
+
+void encodePage(const Snapshot::Page& page, std::vector<std::uint8_t>& out) {
+    u32 i = 0;
+    while (i < Snapshot::PAGE_CELLS) {
+        u32 run = 1;
+        while (i + run < Snapshot::PAGE_CELLS && page[i + run] == page[i]) ++run;
+        if (run >= kMinRun) {
+            putU32LE(out, kRunBit | run);
+            putU32LE(out, static_cast<u32>(page[i]));
+            i += run;
+            continue;
+        }
+        // Literals up to the start of the next worthwhile run.
+        u32 end = i;
+        while (end < Snapshot::PAGE_CELLS) {
+            u32 r = 1;
+            while (end + r < Snapshot::PAGE_CELLS && r < kMinRun && page[end + r] == page[end]) ++r;
+            if (r >= kMinRun) break;
+            end += r;
+        }
+        putU32LE(out, end - i);
+        for (; i < end; ++i) putU32LE(out, static_cast<u32>(page[i]));
+    }
+}
+
+bool decodePage(const std::vector<std::uint8_t>& in, std::size_t& pos, Snapshot::Page& page) {
+    u32 i = 0;
+    while (i < Snapshot::PAGE_CELLS) {
+        u32 header, v;
+        if (!getU32LE(in, pos, header)) return false;
+        const u32 count = header & ~kRunBit;
+        if (count == 0 || count > Snapshot::PAGE_CELLS - i) return false;
+        if (header & kRunBit) {
+            if (!getU32LE(in, pos, v)) return false;
+            std::fill(page.begin() + i, page.begin() + i + count, static_cast<i32>(v));
+            i += count;
+        } else {
+            for (u32 k = 0; k < count; ++k) {
+                if (!getU32LE(in, pos, v)) return false;
+                page[i++] = static_cast<i32>(v);
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool saveSnapshotToFile(const Snapshot& snap, const std::string& path, bool compress, std::string* outError) {
+    std::vector<std::uint8_t> buf(kMagic.begin(), kMagic.end());
+    putU32LE(buf, kVersion);
+    putU32LE(buf, compress ? kFlagRle : 0);
+    putU32LE(buf, snap.ip);
+    putU32LE(buf, snap.sp);
+    putU32LE(buf, snap.irqPending);
+    putU32LE(buf, (snap.inIrq ? 1u : 0u) | (snap.waiting ? 2u : 0u) | (snap.halted ? 4u : 0u));
+    putU32LE(buf, Snapshot::PAGE_COUNT);
+
+    static const Snapshot::Page kZeroPage{};
+    for (const auto& p : snap.pages) {
+        const Snapshot::Page& page = p ? *p : kZeroPage;
+        if (compress) {
+            encodePage(page, buf);
+        } else {
+            for (i32 v : page) putU32LE(buf, static_cast<u32>(v));
+        }
+    }
+
+    std::ofstream f(path, std::ios::binary);
+    if (!f) {
+        setError(outError, "Failed to open for write: " + path);
+        return false;
+    }
+    f.write(reinterpret_cast<const char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+    if (!f) {
+        setError(outError, "Failed to write snapshot: " + path);
+        return false;
+    }
+    return true;
+}
+
+bool loadSnapshotFromFile(const std::string& path, Snapshot& out, std::string* outError) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        setError(outError, "Failed to open for read: " + path);
+        return false;
+    }
+    const std::vector<std::uint8_t> buf((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    if (buf.size() < kMagic.size() || !std::equal(kMagic.begin(), kMagic.end(), buf.begin())) {
+        setError(outError, "Bad magic (not an LJSS file)");
+        return false;
+    }
+    std::size_t pos = kMagic.size();
+    u32 version, flags, state, pageCount;
+    Snapshot snap;
+    if (!getU32LE(buf, pos, version) || !getU32LE(buf, pos, flags) ||
+        !getU32LE(buf, pos, snap.ip) || !getU32LE(buf, pos, snap.sp) ||
+        !getU32LE(buf, pos, snap.irqPending) || !getU32LE(buf, pos, state) ||
+        !getU32LE(buf, pos, pageCount)) {
+        setError(outError, "Truncated snapshot header");
+        return false;
+    }
+    if (version != kVersion) {
+        setError(outError, "Unsupported snapshot version: " + std::to_string(version));
+        return false;
+    }
+    if (pageCount != Snapshot::PAGE_COUNT) {
+        setError(outError, "Unexpected page count: " + std::to_string(pageCount));
+        return false;
+    }
+    snap.inIrq = (state & 1u) != 0;
+    snap.waiting = (state & 2u) != 0;
+    snap.halted = (state & 4u) != 0;
+
+    for (u32 p = 0; p < pageCount; ++p) {
+        auto page = std::make_shared<Snapshot::Page>();
+        bool ok = true;
+        if (flags & kFlagRle) {
+            ok = decodePage(buf, pos, *page);
+        } else {
+            for (u32 i = 0; i < Snapshot::PAGE_CELLS; ++i) {
+                u32 v;
+                if (!(ok = getU32LE(buf, pos, v))) break;
+                (*page)[i] = static_cast<i32>(v);
+            }
+        }
+        if (!ok) {
+            setError(outError, "Corrupt or truncated page " + std::to_string(p));
+            return false;
+        }
+        snap.pages[p] = std::move(page);
+    }
+    snap.pagesCopied = pageCount;
+    out = std::move(snap);
+    return true;
+}
+
+} // namespace vm32
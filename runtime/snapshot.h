@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <string>
+
+#include "../bytecode/opcodes.h"
+
+namespace vm32 {
+
+// Page-granular save state of a VM (see VM::snapshot()). Pages are immutable
+// and shared between snapshots and forked VMs, so a snapshot only allocates the
+// pages written since the previous snapshot or restore of the same VM.
+// Device registers live in the I/O page and are captured with memory.
+struct Snapshot {
+    static constexpr u32 PAGE_CELLS = 1024;
+    static constexpr u32 PAGE_COUNT = 64; // covers VM::MEM_SIZE
+    using Page = std::array<i32, PAGE_CELLS>;
+
+    std::array<std::shared_ptr<const Page>, PAGE_COUNT> pages;
+    u32 ip{0};
+    u32 sp{0};
+    u32 irqPending{0};
+    bool inIrq{false};
+    bool waiting{false};
+    bool halted{false};
+    u32 pagesCopied{0}; // pages allocated by this snapshot rather than shared
+};
+
+// File format:
+//   magic[8]   = "LJSS\r\n\x1A\n"
+//   version    = u32 (currently 1)
+//   flags      = u32 (bit 0: pages are run-length encoded)
+//   ip, sp, irqPending, state = u32 each (state: bit 0 inIrq, 1 waiting, 2 halted)
+//   pageCount  = u32, then pageCount pages of PAGE_CELLS cells
+//
+// An encoded page is a sequence of u32 headers: with the top bit set the low
+// 31 bits are a repeat count for the single cell that follows, otherwise the
+// header counts literal cells that follow. All values are little-endian.
+// Loaded snapshots own all their pages; nothing is shared with the saved VM.
+
+bool saveSnapshotToFile(const Snapshot& snap, const std::string& path, bool compress, std::string* outError = nullptr);
+
+bool loadSnapshotFromFile(const std::string& path, Snapshot& out, std::string* outError = nullptr);
+
+} // namespace vm32
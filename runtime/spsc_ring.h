@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace vm32 {
+
+// Single-producer/single-consumer ring buffer. One thread may call write()
+// while another calls read(); neither ever blocks or takes a lock. Capacity is
+// rounded up to a power of two and one slot is kept free to tell full from empty.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t capacity) {
+        std::size_t cap = 2;
+        while (cap < capacity + 1) cap <<= 1;
+        m_buf.resize(cap);
+        m_mask = cap - 1;
+    }
+
+    // Producer side. Returns the number of items written.
+    std::size_t write(const T* src, std::size_t n) {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        const std::size_t tail = m_tail.load(std::memory_order_acquire);
+        const std::size_t space = (tail - head - 1) & m_mask;
+        if (n > space) n = space;
+        for (std::size_t i = 0; i < n; ++i) m_buf[(head + i) & m_mask] = src[i];
+        m_head.store((head + n) & m_mask, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side. Returns the number of items read.
+    std::size_t read(T* dst, std::size_t n) {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        const std::size_t head = m_head.load(std::memory_order_acquire);
+        const std::size_t avail = (head - tail) & m_mask;
+        if (n > avail) n = avail;
+        for (std::size_t i = 0; i < n; ++i) dst[i] = m_buf[(tail + i) & m_mask];
+        m_tail.store((tail + n) & m_mask, std::memory_order_release);
+        return n;
+    }
+
+    std::size_t space() const {
+        return (m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_relaxed) - 1) & m_mask;
+    }
+
+private:
+    std::vector<T> m_buf;
+    std::size_t m_mask{0};
+    alignas(64) std::atomic<std::size_t> m_head{0}; // written by the producer
+    alignas(64) std::atomic<std::size_t> m_tail{0}; // written by the consumer
+};
+
+} // namespace vm32
@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "vm.h"
+#include "../bytecode/basic_blocks.h"
+#include "../bytecode/opcode_info.h"
+
+// Decoding shared by the translators (the aot tool and the register IR), so
+// both hand the same instructions back to the interpreter.
+
+namespace vm32 {
+
+struct DecodedInsn {
+    u32 addr;
+    Op op;
+    u32 a; // operands, when present
+    u32 b;
+    u32 next;
+};
+
+// Instructions translated code always hands back to the interpreter.
+inline bool handedBack(const DecodedInsn& in) {
+    switch (in.op) {
+        case Op::HALT: case Op::HALT_UNTIL_IRQ: case Op::RETI:
+        case Op::SPAWN: case Op::YIELD: case Op::JOIN:
+        case Op::PRINT: case Op::SYSCALL:
+        case Op::LOAD_ACQ: case Op::STORE_REL: case Op::CAS: case Op::XADD:
+        case Op::ALLOC: case Op::FREE: case Op::REALLOC:
+            return true;
+        case Op::LOAD: return in.a >= VM::MEM_SIZE || in.a == VM::CORE_ID_ADDR;
+        case Op::STORE: // enabling a line may deliver a pending interrupt; DMA_CTRL starts a copy
+            return in.a >= VM::MEM_SIZE || in.a == VM::BARRIER_ADDR || in.a == VM::IRQ_ENABLE_ADDR || in.a == VM::DMA_CTRL_ADDR;
+        case Op::JMP: return in.a >= VM::MEM_SIZE;
+        default: return false;
+    }
+}
+
+// Instructions [first, last) translated as one block; `exit` is the address of
+// the handed-back instruction that ends it, or ~0u. A piece may be empty when
+// a block starts with a handed-back instruction.
+struct TranslationPiece {
+    std::size_t first;
+    std::size_t last;
+    u32 exit;
+};
+
+// Decodes code loaded at cell 0 and splits its basic blocks into pieces, cut
+// after each handed-back instruction. Returns the index of the first data
+// cell, as findBasicBlocks does.
+inline std::size_t decodePieces(const u32* code, std::size_t count,
+                                std::vector<DecodedInsn>& insns, std::vector<TranslationPiece>& pieces) {
+    std::size_t codeEnd = 0;
+    const std::vector<BasicBlock> blocks = findBasicBlocks(code, count, &codeEnd);
+
+    insns.clear();
+    std::vector<std::size_t> index(codeEnd + 1, 0); // address -> instruction
+    for (u32 pc = 0; pc < codeEnd;) {
+        OpInfo info{};
+        if (!opInfo(code[pc], info)) break;
+        DecodedInsn in{ pc, static_cast<Op>(code[pc]), 0, 0, pc + 1 + info.operands };
+        if (info.operands > 0) in.a = code[pc + 1];
+        if (info.operands > 1) in.b = code[pc + 2];
+        index[pc] = insns.size();
+        insns.push_back(in);
+        pc = in.next;
+    }
+
+    pieces.clear();
+    for (const BasicBlock& bb : blocks) {
+        std::size_t first = index[bb.start];
+        const std::size_t end = bb.end < codeEnd ? index[bb.end] : insns.size();
+        for (std::size_t i = first; i < end; ++i) {
+            if (!handedBack(insns[i])) continue;
+            pieces.push_back({ first, i, insns[i].addr });
+            first = i + 1;
+        }
+        if (first < end) pieces.push_back({ first, end, ~0u });
+    }
+    return codeEnd;
+}
+
+// Lowest and highest stack depth reached by instructions [first, last),
+// relative to the depth at entry.
+inline void stackBounds(const std::vector<DecodedInsn>& insns, std::size_t first, std::size_t last, int& lowest, int& highest) {
+    int depth = 0;
+    lowest = 0;
+    highest = 0;
+    for (std::size_t i = first; i < last; ++i) {
+        int pops, pushes;
+        stackEffect(insns[i].op, pops, pushes);
+        depth -= pops;
+        lowest = std::min(lowest, depth);
+        depth += pushes;
+        highest = std::max(highest, depth);
+    }
+}
+
+} // namespace vm32
@@ -0,0 +1,137 @@
+#include "video.h"
+
+#include <cstring>
+
+// The AVX2 path is compiled with a target attribute and picked at run time,
+// so default builds still use it on CPUs that have it.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LJ_VIDEO_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace vm32 {
+
+namespace {
+
+constexpr u32 W = VM::FB_WIDTH;
+constexpr u32 H = VM::FB_HEIGHT;
+
+// Unpack one 8-pixel row of a tile pattern into colour indices.
+inline void patternRow(const i32* mem, u32 tile, u32 row, bool flipX, std::uint8_t out[8]) {
+    const i32* p = mem + VM::TILE_BASE + (tile & (VM::TILE_COUNT - 1)) * VM::TILE_CELLS + row * 2;
+    const std::uint64_t bits = static_cast<std::uint64_t>(static_cast<u32>(p[0])) |
+                               (static_cast<std::uint64_t>(static_cast<u32>(p[1])) << 32);
+    if (flipX) {
+        for (int i = 0; i < 8; ++i) out[i] = static_cast<std::uint8_t>(bits >> (8 * (7 - i)));
+    } else {
+        for (int i = 0; i < 8; ++i) out[i] = static_cast<std::uint8_t>(bits >> (8 * i));
+    }
+}
+
+// Write a span of colour indices through the palette, skipping index 0.
+// Branch-free so the compiler can vectorise it.
+inline void blendSpan(std::uint32_t* dst, const std::uint8_t* idx, u32 n, const std::uint32_t* pal) {
+    for (u32 i = 0; i < n; ++i) {
+        const std::uint32_t c = pal[idx[i]];
+        dst[i] = idx[i] ? c : dst[i];
+    }
+}
+
+void drawTileLine(const i32* mem, u32 y, std::uint32_t* line, const std::uint32_t* pal) {
+    const u32 scrollX = static_cast<u32>(mem[VM::SCROLL_X_ADDR]);
+    const u32 scrollY = static_cast<u32>(mem[VM::SCROLL_Y_ADDR]);
+    const u32 planeY = (y + scrollY) & (VM::TMAP_ROWS * 8 - 1);
+    const i32* mapRow = mem + VM::TMAP_BASE + (planeY >> 3) * VM::TMAP_COLS;
+
+    std::uint8_t idx[W + 8];
+    const u32 firstCol = (scrollX >> 3);
+    for (u32 t = 0; t <= W / 8; ++t) {
+        const u32 cell = static_cast<u32>(mapRow[(firstCol + t) & (VM::TMAP_COLS - 1)]);
+        const u32 fy = (cell & VM::TILE_FLIP_Y) ? 7 - (planeY & 7) : (planeY & 7);
+        patternRow(mem, cell & 0xFF, fy, (cell & VM::TILE_FLIP_X) != 0, idx + t * 8);
+    }
+    blendSpan(line, idx + (scrollX & 7), W, pal);
+}
+
+void drawSpriteLine(const i32* mem, u32 y, bool behind, std::uint32_t* line, const std::uint32_t* pal) {
+    // Highest number first so that lower-numbered sprites end up on top.
+    for (u32 s = VM::SPR_COUNT; s-- > 0;) {
+        const u32 attr = static_cast<u32>(mem[VM::SPR_BASE + s * VM::SPR_CELLS + 1]);
+        if (!(attr & VM::SPR_ENABLE) || ((attr & VM::SPR_BEHIND) != 0) != behind) continue;
+
+        const u32 pos = static_cast<u32>(mem[VM::SPR_BASE + s * VM::SPR_CELLS]);
+        const int sx = static_cast<std::int16_t>(pos & 0xFFFF);
+        const int sy = static_cast<std::int16_t>(pos >> 16);
+        const int row = static_cast<int>(y) - sy;
+        if (row < 0 || row >= 8 || sx <= -8 || sx >= static_cast<int>(W)) continue;
+
+        std::uint8_t idx[8];
+        const u32 fy = (attr & VM::SPR_FLIP_Y) ? 7 - row : row;
+        patternRow(mem, attr & 0xFF, fy, (attr & VM::SPR_FLIP_X) != 0, idx);
+
+        const int x0 = sx < 0 ? -sx : 0;
+        const int x1 = (sx + 8 > static_cast<int>(W)) ? static_cast<int>(W) - sx : 8;
+        blendSpan(line + sx + x0, idx + x0, static_cast<u32>(x1 - x0), pal);
+    }
+}
+
+#if defined(LJ_VIDEO_AVX2)
+bool hasAvx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+
+// 8 pixels per iteration: widen 8 index bytes to 32-bit lanes, then gather.
+// Returns the number of pixels done, a multiple of 8.
+__attribute__((target("avx2")))
+u32 expandIndexedAvx2(const std::uint8_t* idx, const std::uint32_t* pal, std::uint32_t* out, u32 count) {
+    const int* table = reinterpret_cast<const int*>(pal);
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(idx + i));
+        const __m256i lanes = _mm256_cvtepu8_epi32(bytes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(table, lanes, 4));
+    }
+    return i;
+}
+#endif
+
+} // namespace
+
+void expandIndexed(const i32* cells, const std::uint32_t* pal, std::uint32_t* out, u32 count) {
+    u32 i = 0;
+#if defined(LJ_VIDEO_AVX2)
+    if (hasAvx2()) i = expandIndexedAvx2(reinterpret_cast<const std::uint8_t*>(cells), pal, out, count);
+#endif
+    // Portable path: one cell (4 pixels) at a time, independent of host byte order.
+    for (; i < count; i += 4) {
+        const u32 c = static_cast<u32>(cells[i / 4]);
+        out[i + 0] = pal[c & 0xFF];
+        out[i + 1] = pal[(c >> 8) & 0xFF];
+        out[i + 2] = pal[(c >> 16) & 0xFF];
+        out[i + 3] = pal[c >> 24];
+    }
+}
+
+void composeFrame(const VM& vm, std::uint32_t* out) {
+    const i32* mem = vm.memData();
+    const std::uint32_t* pal = reinterpret_cast<const std::uint32_t*>(mem + VM::PAL_BASE);
+
+    if (static_cast<u32>(mem[VM::FB_MODE_ADDR]) == VM::FB_MODE_INDEXED8) {
+        expandIndexed(mem + VM::FB_BASE, pal, out, VM::FB_SIZE);
+    } else {
+        std::memcpy(out, mem + VM::FB_BASE, VM::FB_SIZE * sizeof(std::uint32_t));
+    }
+
+    const u32 ctrl = static_cast<u32>(mem[VM::GFX_CTRL_ADDR]);
+    if ((ctrl & (VM::GFX_TILES | VM::GFX_SPRITES)) == 0) return;
+
+    for (u32 y = 0; y < H; ++y) {
+        std::uint32_t* line = out + y * W;
+        if (ctrl & VM::GFX_SPRITES) drawSpriteLine(mem, y, true, line, pal);
+        if (ctrl & VM::GFX_TILES)   drawTileLine(mem, y, line, pal);
+        if (ctrl & VM::GFX_SPRITES) drawSpriteLine(mem, y, false, line, pal);
+    }
+}
+
+} // namespace vm32
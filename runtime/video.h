@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+#include "vm.h"
+
+namespace vm32 {
+
+// Build the image to present for the current frame into `out`
+// (VM::FB_WIDTH x VM::FB_HEIGHT ARGB8888 pixels). Starts from the framebuffer,
+// expanded through the palette when FB_MODE_ADDR selects indexed colour, and,
+// depending on GFX_CTRL_ADDR, draws sprites flagged SPR_BEHIND, the
+// scrolled tile layer, then the remaining sprites. Lower sprite numbers are
+// drawn on top of higher ones. VM memory is not modified.
+void composeFrame(const VM& vm, std::uint32_t* out);
+
+// Expand `count` packed 8-bit indices (4 per cell, low byte first) to ARGB8888.
+// `count` must be a multiple of 4.
+void expandIndexed(const i32* cells, const std::uint32_t* pal, std::uint32_t* out, u32 count);
+
+} // namespace vm32
@@ -1,12 +1,57 @@
 #include "vm.h"
+#include "aot_abi.h"
+#include "atomic_cell.h"
+#include "dma.h"
+#include "multicore.h"
+#include "packed_lanes.h"
+#include "register_ir.h"
+#include "../bytecode/disasm.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 
 namespace vm32 {
 
-VM::VM(std::size_t stackCapacity) : m_stackCap(stackCapacity) {
-    m_mem.assign(MEM_SIZE, 0);
+namespace {
+
+// Condition for the fused compare-and-branch opcodes (register and immediate forms).
+inline bool branchTaken(Op op, i32 a, i32 b) {
+    switch (op) {
+        case Op::JEQ: case Op::JEQ_IMM: return a == b;
+        case Op::JNE: case Op::JNE_IMM: return a != b;
+        case Op::JLT: case Op::JLT_IMM: return a < b;
+        case Op::JLE: case Op::JLE_IMM: return a <= b;
+        case Op::JGT: case Op::JGT_IMM: return a > b;
+        case Op::JGE: case Op::JGE_IMM: return a >= b;
+        default: return false;
+    }
+}
+
+} // namespace
+
+VM::VM(std::size_t stackCapacity)
+    : m_storage(std::make_shared<std::vector<i32>>(MEM_SIZE, 0)), m_mem(*m_storage), m_stackCap(stackCapacity) {
     m_sp = STACK_BASE;
     m_ip = CODE_BASE;
+    m_out.reserve(OUT_BUFFER_SIZE);
+    m_mem[CORE_COUNT_ADDR] = 1;
+    initThreads();
+    setHeapRegion(HEAP_BASE, HEAP_CELLS);
+}
+
+VM::VM(std::shared_ptr<std::vector<i32>> storage, u32 coreId)
+    : m_storage(std::move(storage)), m_mem(*m_storage), m_stackCap(CORE_STACK_CELLS),
+      m_stackBase(STACK_BASE + coreId * CORE_STACK_CELLS), m_coreId(coreId) {
+    // Thread 0 of this core; the shared thread table belongs to core 0.
+    m_sp = m_stackBase;
+    setStackBounds(0);
+    m_out.reserve(OUT_BUFFER_SIZE);
+}
+
+VM::~VM() {
+    flushOutput();
 }
 
 void VM::load(const std::vector<u32>& codeCells) {
@@ -14,18 +59,98 @@ void VM::load(const std::vector<u32>& codeCells) {
     for (u32 i = 0; i < codeCells.size() && (CODE_BASE + i) < MEM_SIZE; ++i) {
         m_mem[CODE_BASE + i] = static_cast<i32>(codeCells[i]);
     }
+    m_dirtyPages = ~std::uint64_t{0};
+    m_codeSize = static_cast<u32>(std::min<std::size_t>(codeCells.size(), MEM_SIZE - CODE_BASE));
+    m_gasTable = buildGasTable(reinterpret_cast<const u32*>(m_mem.data() + CODE_BASE), m_codeSize, m_gasSchedule);
+    if (m_regIrOn) setRegisterIr(true);
+    enterRun();
 }
 
 void VM::reset() {
+    waitDma();
     std::fill(m_mem.begin(), m_mem.end(), 0);
-    m_sp = STACK_BASE;
+    m_sp = m_stackBase;
     m_ip = CODE_BASE;
+    m_mem[CORE_COUNT_ADDR] = 1;
+    initThreads();
+    m_heap.init(m_mem.data());
+    m_irqPending.store(0, std::memory_order_relaxed);
+    m_inIrq = false;
+    m_waiting = false;
+    m_halted = false;
+    m_dirtyPages = ~std::uint64_t{0};
+    m_codeSize = 0;
+    m_gasTable.clear();
+    detachNative();
+    m_regIr.reset();
+    enterRun();
 }
 
 void VM::setKeyboardState(u32 mask) {
     if (KB_STATE_ADDR < m_mem.size()) {
+        if (static_cast<u32>(m_mem[KB_STATE_ADDR]) != mask) raiseIrq(IRQ_KEY);
         m_mem[KB_STATE_ADDR] = static_cast<i32>(mask);
+        markDirty(KB_STATE_ADDR);
+    }
+}
+
+bool VM::pushInputEvent(u32 type, u32 scancode, u32 timestampMs) {
+    const u32 head = static_cast<u32>(m_mem[EVQ_HEAD_ADDR]) & (EVQ_CAPACITY - 1);
+    const u32 tail = static_cast<u32>(m_mem[EVQ_TAIL_ADDR]) & (EVQ_CAPACITY - 1);
+    const u32 next = (head + 1) & (EVQ_CAPACITY - 1);
+    if (next == tail) return false;
+
+    const u32 entry = EVQ_BASE + head * EVQ_ENTRY_CELLS;
+    m_mem[entry + 0] = static_cast<i32>((type << 16) | (scancode & 0xFFFFu));
+    m_mem[entry + 1] = static_cast<i32>(timestampMs);
+    m_mem[EVQ_HEAD_ADDR] = static_cast<i32>(next);
+    markDirty(entry);
+    markDirty(EVQ_HEAD_ADDR);
+    raiseIrq(IRQ_KEY);
+    return true;
+}
+
+std::size_t VM::readAudio(std::int16_t* out, std::size_t maxSamples) {
+    const u32 wptr = static_cast<u32>(m_mem[AUD_WPTR_ADDR]) & (AUD_CAPACITY - 1);
+    u32 rptr = static_cast<u32>(m_mem[AUD_RPTR_ADDR]) & (AUD_CAPACITY - 1);
+    std::size_t n = 0;
+    while (n < maxSamples && rptr != wptr) {
+        out[n++] = static_cast<std::int16_t>(m_mem[AUD_BASE + rptr] & 0xFFFF);
+        rptr = (rptr + 1) & (AUD_CAPACITY - 1);
     }
+    m_mem[AUD_RPTR_ADDR] = static_cast<i32>(rptr);
+    markDirty(AUD_RPTR_ADDR);
+    return n;
+}
+
+void VM::raiseIrq(u32 line) {
+    if (line < IRQ_LINES) m_irqPending.fetch_or(1u << line, std::memory_order_release);
+}
+
+bool VM::serviceIrq(Result& r) {
+    if (m_inIrq) return true;
+    const u32 ready = m_irqPending.load(std::memory_order_acquire) & static_cast<u32>(m_mem[IRQ_ENABLE_ADDR]);
+    if (ready == 0) return true;
+
+    u32 line = 0;
+    while (!(ready & (1u << line))) ++line;
+    m_irqPending.fetch_and(~(1u << line), std::memory_order_acq_rel);
+    m_waiting = false;
+
+    const u32 vector = static_cast<u32>(m_mem[IRQ_VEC_BASE + line]);
+    if (vector == 0) return true;
+    if (vector >= MEM_SIZE) { r.ok = false; r.error = "IRQ vector out of range"; return false; }
+    if (!push(static_cast<i32>(m_ip))) { r.ok = false; r.error = "Stack overflow (IRQ)"; return false; }
+    if (m_gasOn && !m_gasPending && m_ip < m_gasTable.size() && m_gasTable[m_ip] != GAS_UNMETERED) {
+        addGas(m_gasTable[m_ip]); // prepaid rest of the interrupted run; charged again after RETI
+    }
+    enterRun();
+    m_mem[IRQ_CAUSE_ADDR] = static_cast<i32>(line);
+    markDirty(IRQ_CAUSE_ADDR);
+    m_irqFrom = m_ip;
+    m_inIrq = true;
+    m_ip = vector;
+    return true;
 }
 
 u32 VM::keyboardState() const {
@@ -35,56 +160,605 @@ u32 VM::keyboardState() const {
     return 0;
 }
 
+void VM::flushOutput() {
+    if (m_out.empty()) return;
+    if (m_outFile) {
+        std::fwrite(m_out.data(), 1, m_out.size(), m_outFile);
+        std::fflush(m_outFile);
+    }
+    m_out.clear();
+}
+
+bool VM::registerSyscall(u32 n, const Syscall& sc) {
+    if (n >= MAX_SYSCALLS || !sc.fn) return false;
+    if (m_syscalls.size() <= n) m_syscalls.resize(n + 1);
+    m_syscalls[n] = sc;
+    return true;
+}
+
+void VM::drainConsole() {
+    u32 cursor = static_cast<u32>(m_mem[CON_CURSOR_ADDR]);
+    if (cursor == 0) return;
+    if (cursor > CON_SIZE) cursor = CON_SIZE;
+
+    for (u32 row = 0; row * CON_COLS < cursor; ++row) {
+        const u32 rowBase = CON_BASE + row * CON_COLS;
+        const u32 rowEnd = (cursor - row * CON_COLS < CON_COLS) ? cursor - row * CON_COLS : CON_COLS;
+        u32 len = rowEnd;
+        while (len > 0 && ((m_mem[rowBase + len - 1] & 0xFF) == 0 || (m_mem[rowBase + len - 1] & 0xFF) == ' ')) --len;
+        for (u32 c = 0; c < len; ++c) {
+            const char ch = static_cast<char>(m_mem[rowBase + c] & 0xFF);
+            m_out.push_back(ch == 0 ? ' ' : ch);
+        }
+        m_out.push_back('\n');
+        std::fill(m_mem.begin() + rowBase, m_mem.begin() + rowBase + rowEnd, 0);
+        markDirty(rowBase);
+        markDirty(rowBase + rowEnd - 1);
+    }
+    m_mem[CON_CURSOR_ADDR] = 0;
+    markDirty(CON_CURSOR_ADDR);
+    if (m_out.size() >= OUT_BUFFER_SIZE) flushOutput();
+}
+
+Snapshot VM::snapshot() {
+    waitDma();
+    Snapshot snap;
+    const std::uint64_t dirty = m_dirtyPages | stackDirtyMask();
+    for (u32 p = 0; p < Snapshot::PAGE_COUNT; ++p) {
+        const i32* cells = m_mem.data() + p * Snapshot::PAGE_CELLS;
+        const auto& base = m_basePages[p];
+        // A written page whose contents came back unchanged is still shared.
+        if (base && (!(dirty & (std::uint64_t{1} << p)) ||
+                     std::memcmp(base->data(), cells, sizeof(Snapshot::Page)) == 0)) {
+            snap.pages[p] = base;
+            continue;
+        }
+        auto page = std::make_shared<Snapshot::Page>();
+        std::memcpy(page->data(), cells, sizeof(Snapshot::Page));
+        snap.pages[p] = std::move(page);
+        ++snap.pagesCopied;
+    }
+    snap.ip = m_ip;
+    snap.sp = m_sp;
+    snap.irqPending = m_irqPending.load(std::memory_order_acquire);
+    snap.inIrq = m_inIrq;
+    snap.waiting = m_waiting;
+    snap.halted = m_halted;
+
+    m_basePages = snap.pages;
+    m_dirtyPages = 0;
+    return snap;
+}
+
+void VM::restore(const Snapshot& snap) {
+    waitDma();
+    m_dirtyPages |= stackDirtyMask();
+    for (u32 p = 0; p < Snapshot::PAGE_COUNT; ++p) {
+        const auto& page = snap.pages[p];
+        if (page && page == m_basePages[p] && !(m_dirtyPages & (std::uint64_t{1} << p))) continue;
+        i32* cells = m_mem.data() + p * Snapshot::PAGE_CELLS;
+        if (page) std::memcpy(cells, page->data(), sizeof(Snapshot::Page));
+        else std::fill(cells, cells + Snapshot::PAGE_CELLS, 0);
+    }
+    m_ip = snap.ip;
+    m_sp = snap.sp;
+    m_irqPending.store(snap.irqPending, std::memory_order_release);
+    m_inIrq = snap.inIrq;
+    m_waiting = snap.waiting;
+    m_halted = snap.halted;
+    m_thread = static_cast<u32>(m_mem[THREAD_ID_ADDR]) & (THREAD_SLOTS - 1);
+    setStackBounds(m_thread);
+    enterRun();
+
+    m_basePages = snap.pages;
+    m_dirtyPages = 0;
+    for (u32 p = 0; p < Snapshot::PAGE_COUNT; ++p) {
+        if (!snap.pages[p]) m_dirtyPages |= std::uint64_t{1} << p;
+    }
+}
+
+bool VM::makeCores(u32 count, std::vector<std::unique_ptr<VM>>& out, std::string* outError) {
+    std::string error;
+    if (count == 0 || count > MAX_CORES) error = "Core count must be 1.." + std::to_string(MAX_CORES);
+    else if (m_coreId != 0 || m_barrier) error = "Cores already running";
+    else if (count > 1 && stackLimit() > STACK_BASE + CORE_STACK_CELLS) error = "Core 0 stack must be CORE_STACK_CELLS or less";
+    if (!error.empty()) {
+        if (outError) *outError = error;
+        return false;
+    }
+
+    m_barrier = std::make_shared<CoreBarrier>(count);
+    if (m_gasOn) m_sharedGas = std::make_shared<std::atomic<std::uint64_t>>(m_gas);
+    out.clear();
+    for (u32 k = 1; k < count; ++k) {
+        std::unique_ptr<VM> core(new VM(m_storage, k));
+        core->m_ip = m_ip;
+        core->m_barrier = m_barrier;
+        core->m_syscalls = m_syscalls;
+        core->m_outFile = m_outFile;
+        core->m_gasSchedule = m_gasSchedule;
+        core->m_gasTable = m_gasTable;
+        core->m_codeSize = m_codeSize;
+        core->m_sharedGas = m_sharedGas;
+        core->m_gasOn = m_gasOn;
+        core->enterRun();
+        out.push_back(std::move(core));
+    }
+    m_mem[CORE_COUNT_ADDR] = static_cast<i32>(count);
+    m_dirtyPages = ~std::uint64_t{0};
+    return true;
+}
+
+void VM::releaseCores() {
+    m_barrier.reset();
+    if (m_sharedGas) {
+        m_gas = m_sharedGas->load(std::memory_order_relaxed);
+        m_sharedGas.reset();
+    }
+    m_mem[CORE_COUNT_ADDR] = 1;
+    markDirty(CORE_COUNT_ADDR);
+}
+
+bool VM::writeMem(u32 addr, const i32* cells, std::size_t count, std::string* outError) {
+    std::string error;
+    if (addr > MEM_SIZE || count > MEM_SIZE - addr) error = "Write out of range";
+    else if (addr < IO_BASE + IO_SIZE && addr + count > IO_BASE) error = "Write overlaps the I/O page";
+    if (!error.empty()) {
+        if (outError) *outError = error;
+        return false;
+    }
+
+    waitDma();
+    std::copy(cells, cells + count, m_mem.begin() + addr);
+    m_dirtyPages |= pageMask(addr, static_cast<u32>(count));
+    return true;
+}
+
+bool VM::setDmaBlob(u32 id, std::shared_ptr<const std::vector<i32>> cells) {
+    if (id >= MAX_DMA_BLOBS) return false;
+    if (id >= m_dmaBlobs.size()) m_dmaBlobs.resize(id + 1);
+    m_dmaBlobs[id] = std::move(cells);
+    return true;
+}
+
+void VM::setDmaSynchronous(bool on) {
+    waitDma();
+    m_dmaSync = on;
+}
+
+void VM::controlDma(u32 ctrl) {
+    if (m_coreId != 0) return;
+    if (ctrl & DMA_WAIT) waitDma();
+    if (!(ctrl & DMA_START)) return;
+    waitDma();
+
+    const u32 src = static_cast<u32>(m_mem[DMA_SRC_ADDR]);
+    const u32 dst = static_cast<u32>(m_mem[DMA_DST_ADDR]);
+    const u32 len = static_cast<u32>(m_mem[DMA_LEN_ADDR]);
+    std::shared_ptr<const std::vector<i32>> blob;
+    const i32* from = nullptr;
+    if (ctrl & DMA_FROM_BLOB) {
+        const u32 id = (ctrl >> DMA_BLOB_SHIFT) & (MAX_DMA_BLOBS - 1);
+        if (id < m_dmaBlobs.size()) blob = m_dmaBlobs[id];
+        if (blob && src <= blob->size() && len <= blob->size() - src) from = blob->data() + src;
+    } else if (src <= MEM_SIZE && len <= MEM_SIZE - src) {
+        from = m_mem.data() + src;
+    }
+    const bool dstOk = dst <= MEM_SIZE && len <= MEM_SIZE - dst && (dst + len <= IO_BASE || dst >= IO_BASE + IO_SIZE);
+
+    markDirty(DMA_STATUS_ADDR);
+    if (!from || !dstOk || len == 0) {
+        m_mem[DMA_STATUS_ADDR] = static_cast<i32>(from && dstOk ? DMA_DONE : DMA_ERROR);
+        raiseIrq(IRQ_DMA);
+        return;
+    }
+    m_dirtyPages |= pageMask(dst, len);
+    if (m_dmaSync) {
+        std::memmove(m_mem.data() + dst, from, len * sizeof(i32));
+        m_mem[DMA_STATUS_ADDR] = static_cast<i32>(DMA_DONE);
+        raiseIrq(IRQ_DMA);
+        return;
+    }
+    m_mem[DMA_STATUS_ADDR] = static_cast<i32>(DMA_BUSY);
+    if (!m_dma) m_dma = std::make_unique<DmaChannel>();
+    DmaChannel::Transfer t;
+    t.dst = m_mem.data() + dst;
+    t.src = from;
+    t.cells = len;
+    t.blob = std::move(blob);
+    t.done = [this] {
+        atomics::storeRelease(&m_mem[DMA_STATUS_ADDR], static_cast<i32>(DMA_DONE));
+        raiseIrq(IRQ_DMA);
+    };
+    m_dma->start(std::move(t));
+}
+
+void VM::waitDma() {
+    if (m_dma) m_dma->wait();
+}
+
+std::uint64_t VM::pageMask(u32 base, u32 cells) {
+    std::uint64_t mask = 0;
+    for (u32 p = base / Snapshot::PAGE_CELLS; p * Snapshot::PAGE_CELLS < base + cells; ++p) {
+        mask |= std::uint64_t{1} << p;
+    }
+    return mask;
+}
+
+void VM::arriveAtBarrier() {
+    if (m_barrier) {
+        flushOutput();
+        m_barrier->arriveAndWait();
+    }
+}
+
+std::unique_ptr<VM> VM::fork() {
+    const Snapshot snap = snapshot();
+    auto child = std::make_unique<VM>(m_stackCap);
+    child->restore(snap);
+    child->m_syscalls = m_syscalls;
+    child->m_outFile = m_outFile;
+    child->m_gasSchedule = m_gasSchedule;
+    child->m_gasTable = m_gasTable;
+    child->m_codeSize = m_codeSize;
+    child->m_gas = gas();
+    child->m_gasOn = m_gasOn;
+    child->m_native = m_native;
+    child->m_nativeEntry = m_nativeEntry;
+    child->m_regIrOn = m_regIrOn;
+    child->m_regIr = m_regIr;
+    child->m_heap = m_heap;
+    child->m_heapPages = m_heapPages;
+    child->m_dmaBlobs = m_dmaBlobs;
+    child->m_dmaSync = m_dmaSync;
+    child->enterRun();
+    return child;
+}
+
+bool VM::setHeapRegion(u32 base, u32 cells, std::string* outError) {
+    std::string error;
+    if (cells < Heap::MIN_CELLS) error = "Heap needs at least " + std::to_string(Heap::MIN_CELLS) + " cells";
+    else if (base > MEM_SIZE - cells) error = "Heap region out of range";
+    else if (base < IO_BASE + IO_SIZE && base + cells > IO_BASE) error = "Heap region overlaps the I/O page";
+    if (!error.empty()) {
+        if (outError) *outError = error;
+        return false;
+    }
+
+    m_heap = Heap(base, cells);
+    m_heap.init(m_mem.data());
+    m_heapPages = pageMask(base, cells);
+    m_dirtyPages |= m_heapPages;
+    return true;
+}
+
+bool VM::heapStats(HeapStats& out, std::string* outError) const {
+    if (const char* err = m_heap.stats(m_mem.data(), out)) {
+        if (outError) *outError = err;
+        return false;
+    }
+    return true;
+}
+
+void VM::enableTrace(std::size_t entries) {
+    std::size_t n = 1;
+    while (n < entries) n <<= 1;
+    m_trace.assign(entries == 0 ? 0 : n, TraceEntry{});
+    m_traceCount = 0;
+}
+
+void VM::dumpTrace(std::FILE* out) const {
+    const std::size_t n = std::min<std::uint64_t>(m_traceCount, m_trace.size());
+    std::fprintf(out, "trace: last %zu of %llu instructions\n", n, static_cast<unsigned long long>(m_traceCount));
+    const u32* cells = reinterpret_cast<const u32*>(m_mem.data());
+    for (std::uint64_t i = m_traceCount - n; i < m_traceCount; ++i) {
+        const TraceEntry& t = m_trace[i & (m_trace.size() - 1)];
+        // Operands are read from memory now; the opcode is the one that ran.
+        std::string text = disassembleAt(cells, MEM_SIZE, t.ip);
+        if (static_cast<u32>(m_mem[t.ip]) != t.op) text = disassembleAt(&t.op, 1, 0) + " (since overwritten)";
+        std::fprintf(out, "  %04x  %-24s tos=%d\n", t.ip, text.c_str(), t.tos);
+    }
+}
+
+void VM::setGasSchedule(const GasSchedule& schedule) {
+    m_gasSchedule = schedule;
+    m_gasTable = buildGasTable(reinterpret_cast<const u32*>(m_mem.data() + CODE_BASE), m_codeSize, m_gasSchedule);
+    enterRun();
+}
+
+void VM::setGas(std::uint64_t gas) {
+    m_gas = gas;
+    m_gasOn = true;
+    enterRun();
+}
+
+bool VM::chargeGas(Result& r) {
+    const u32 cost = m_ip < m_gasTable.size() ? m_gasTable[m_ip] : GAS_UNMETERED;
+    if (cost == GAS_UNMETERED) {
+        r.ok = false;
+        r.error = "Entered unmetered code (gas)";
+        m_insnIp = m_ip;
+        return false;
+    }
+    if (m_sharedGas) {
+        std::uint64_t left = m_sharedGas->load(std::memory_order_relaxed);
+        do {
+            if (cost > left) { r.outOfGas = true; return false; }
+        } while (!m_sharedGas->compare_exchange_weak(left, left - cost, std::memory_order_relaxed));
+    } else if (cost > m_gas) {
+        r.outOfGas = true;
+        return false;
+    } else {
+        m_gas -= cost;
+    }
+    m_gasPending = false;
+    return true;
+}
+
+void VM::enableProfiler(u32 intervalSteps) {
+    m_profileInterval = intervalSteps;
+    m_profileCountdown = intervalSteps;
+    m_profile.clear();
+}
+
+void VM::sampleProfile() {
+    m_profileCountdown = m_profileInterval;
+    const std::uint64_t from = m_inIrq ? static_cast<std::uint64_t>(m_irqFrom) + 1 : 0;
+    ++m_profile[(from << 32) | m_insnIp];
+}
+
+std::vector<ProfileSample> VM::profileSamples() const {
+    std::vector<ProfileSample> out;
+    out.reserve(m_profile.size());
+    for (const auto& kv : m_profile) {
+        const std::uint64_t from = kv.first >> 32;
+        out.push_back({ static_cast<u32>(kv.first), from != 0, from != 0 ? static_cast<u32>(from - 1) : 0, kv.second });
+    }
+    return out;
+}
+
 bool VM::fetchCell(u32& out) {
     if (m_ip >= MEM_SIZE) return false;
     out = static_cast<u32>(m_mem[m_ip++]);
     return true;
 }
 
-bool VM::push(i32 v) {
-    u32 capEnd = STACK_BASE;
+u32 VM::stackLimit() const {
     if (m_stackCap > 0) {
         const u32 cap = static_cast<u32>(m_stackCap);
-        capEnd = (cap > (STACK_LIMIT - STACK_BASE)) ? STACK_LIMIT : (STACK_BASE + cap);
+        return (cap > (STACK_LIMIT - m_stackBase)) ? STACK_LIMIT : (m_stackBase + cap);
+    }
+    return STACK_LIMIT;
+}
+
+std::uint64_t VM::stackDirtyMask() const {
+    const u32 end = std::max(stackLimit(), THREAD_STACK_END);
+    std::uint64_t mask = 0;
+    for (u32 p = STACK_BASE / Snapshot::PAGE_CELLS; p < Snapshot::PAGE_COUNT && p * Snapshot::PAGE_CELLS < end; ++p) {
+        mask |= std::uint64_t{1} << p;
+    }
+    return mask;
+}
+
+void VM::initThreads() {
+    m_thread = 0;
+    setStackBounds(0);
+    tcb(0, TCB_STATE) = THREAD_READY;
+    tcb(0, TCB_NEXT) = 0;
+    tcb(0, TCB_PREV) = 0;
+    m_mem[THREAD_ID_ADDR] = 0;
+    markDirty(THREAD_ID_ADDR);
+}
+
+void VM::setStackBounds(u32 id) {
+    m_stackLo = id == 0 ? m_stackBase : THREAD_STACK_BASE + (id - 1) * THREAD_STACK_CELLS;
+    m_stackHi = id == 0 ? stackLimit() : m_stackLo + THREAD_STACK_CELLS;
+}
+
+void VM::linkBefore(u32 id, u32 at) {
+    const u32 prev = link(at, TCB_PREV);
+    tcb(prev, TCB_NEXT) = static_cast<i32>(id);
+    tcb(id, TCB_PREV) = static_cast<i32>(prev);
+    tcb(id, TCB_NEXT) = static_cast<i32>(at);
+    tcb(at, TCB_PREV) = static_cast<i32>(id);
+}
+
+void VM::unlink(u32 id) {
+    const u32 prev = link(id, TCB_PREV);
+    const u32 next = link(id, TCB_NEXT);
+    tcb(prev, TCB_NEXT) = static_cast<i32>(next);
+    tcb(next, TCB_PREV) = static_cast<i32>(prev);
+    tcb(id, TCB_NEXT) = static_cast<i32>(id);
+    tcb(id, TCB_PREV) = static_cast<i32>(id);
+}
+
+bool VM::switchTo(u32 id, bool saveCurrent, Result& r) {
+    if (saveCurrent) {
+        tcb(m_thread, TCB_IP) = static_cast<i32>(m_ip);
+        tcb(m_thread, TCB_SP) = static_cast<i32>(m_sp);
+    }
+    m_thread = id;
+    setStackBounds(id);
+    const u32 ip = static_cast<u32>(tcb(id, TCB_IP));
+    const u32 sp = static_cast<u32>(tcb(id, TCB_SP));
+    if (ip >= MEM_SIZE || sp < m_stackLo || sp > m_stackHi) { r.ok = false; r.error = "Corrupt thread context"; return false; }
+    m_ip = ip;
+    m_sp = sp;
+    m_mem[THREAD_ID_ADDR] = static_cast<i32>(id);
+    markDirty(THREAD_ID_ADDR);
+    enterRun();
+    return true;
+}
+
+bool VM::finishThread(Result& r) {
+    const u32 cur = m_thread;
+    const i32 result = m_sp > m_stackLo ? m_mem[m_sp - 1] : 0;
+    const u32 next = link(cur, TCB_NEXT);
+    const u32 joiner = static_cast<u32>(tcb(cur, TCB_JOINER));
+    unlink(cur);
+
+    if (joiner == 0) {
+        if (next == cur) { r.ok = false; r.error = "Deadlock: no thread is ready"; return false; }
+        tcb(cur, TCB_STATE) = THREAD_DONE;
+        tcb(cur, TCB_RESULT) = result;
+        return switchTo(next, false, r);
+    }
+
+    // Hand the result straight to the joiner; JOIN left room for it on its stack.
+    const u32 j = (joiner - 1) & (THREAD_SLOTS - 1);
+    const u32 jsp = static_cast<u32>(tcb(j, TCB_SP));
+    const u32 jlo = j == 0 ? m_stackBase : THREAD_STACK_BASE + (j - 1) * THREAD_STACK_CELLS;
+    const u32 jhi = j == 0 ? stackLimit() : jlo + THREAD_STACK_CELLS;
+    if (jsp < jlo || jsp >= jhi) { r.ok = false; r.error = "Corrupt thread context"; return false; }
+    m_mem[jsp] = result;
+    tcb(j, TCB_SP) = static_cast<i32>(jsp + 1);
+    tcb(j, TCB_STATE) = THREAD_READY;
+    tcb(cur, TCB_STATE) = THREAD_FREE;
+    if (next == cur) {
+        tcb(j, TCB_NEXT) = static_cast<i32>(j);
+        tcb(j, TCB_PREV) = static_cast<i32>(j);
     } else {
-        capEnd = STACK_LIMIT;
+        linkBefore(j, next);
     }
-    if (m_sp >= capEnd) return false;
+    return switchTo(next == cur ? j : next, false, r);
+}
+
+bool VM::push(i32 v) {
+    if (m_sp >= m_stackHi) return false;
     m_mem[m_sp++] = v;
     return true;
 }
 
 bool VM::pop(i32& out) {
-    if (m_sp <= STACK_BASE) return false;
+    if (m_sp <= m_stackLo) return false;
     out = m_mem[--m_sp];
     return true;
 }
 
 bool VM::peek2(i32& a, i32& b) {
-    if (m_sp - STACK_BASE < 2) return false;
+    if (m_sp - m_stackLo < 2) return false;
     a = m_mem[m_sp - 1];
     b = m_mem[m_sp - 2];
     return true;
 }
 
+bool VM::attachNative(const LjAotProgram* program, std::string* outError) {
+    std::string error;
+    if (!program) error = "No native program";
+    else if (program->abiVersion != LJ_AOT_ABI_VERSION) error = "Native program ABI version mismatch";
+    else if (program->codeSize != m_codeSize ||
+             program->programHash != lj_aot_hash(reinterpret_cast<const u32*>(m_mem.data() + CODE_BASE), m_codeSize)) {
+        error = "Native program was built from different bytecode";
+    }
+    if (!error.empty()) {
+        if (outError) *outError = error;
+        return false;
+    }
+    m_nativeEntry.assign(m_codeSize, false);
+    for (u32 i = 0; i < program->entryCount; ++i) {
+        if (program->entries[i] < m_codeSize) m_nativeEntry[program->entries[i]] = true;
+    }
+    m_native = program;
+    return true;
+}
+
+void VM::setRegisterIr(bool on) {
+    m_regIrOn = on;
+    m_regIr.reset();
+    if (on) m_regIr = std::make_shared<RegisterProgram>(reinterpret_cast<const u32*>(m_mem.data() + CODE_BASE), m_codeSize);
+}
+
+Result VM::runTranslated(std::size_t maxSteps) {
+    Result r{};
+    std::size_t executed = 0;
+    while (executed < maxSteps) {
+        // Leave the interpreter only where step() would run the next instruction straight away.
+        const bool irqReady = !m_inIrq && (m_irqPending.load(std::memory_order_relaxed) &
+                                           static_cast<u32>(m_mem[IRQ_ENABLE_ADDR])) != 0;
+        const bool entry = m_native ? m_ip < m_nativeEntry.size() && m_nativeEntry[m_ip] : m_regIr->isEntry(m_ip);
+        if (!m_halted && !m_waiting && !irqReady && entry) {
+            LjAotState s{ m_mem.data(), m_ip, m_sp, m_stackLo, m_stackHi,
+                          std::min<std::uint64_t>(maxSteps - executed, NATIVE_SLICE), 0 };
+            const int status = m_native ? m_native->run(&s) : m_regIr->run(s);
+            m_ip = s.ip;
+            m_sp = s.sp;
+            m_dirtyPages = ~std::uint64_t{0};
+            executed += static_cast<std::size_t>(s.steps);
+            if (status == LJ_AOT_BUDGET && s.steps > 0) continue;
+            if (executed >= maxSteps) break;
+        }
+        r = step();
+        if (!r.ok) { flushOutput(); r.steps = executed; return r; }
+        if (r.steps == 0) {
+            r.steps = executed;
+            return r;
+        }
+        executed += r.steps;
+    }
+    r.ok = false;
+    r.error = "Exceeded maxSteps";
+    r.steps = executed;
+    r.faultIp = m_ip;
+    return r;
+}
+
 Result VM::run(std::size_t maxSteps) {
+    if ((m_native || m_regIr) && !m_gasOn && m_trace.empty() && m_profileInterval == 0 && !m_barrier) {
+        return runTranslated(maxSteps);
+    }
     Result r{};
+    std::size_t executed = 0;
     for (std::size_t i = 0; i < maxSteps; ++i) {
         r = step();
-        if (!r.ok) return r;
-        if (r.steps == 0) { // HALT
+        if (!r.ok) { flushOutput(); r.steps = executed; return r; }
+        if (r.steps == 0) { // HALT, or parked in HALT_UNTIL_IRQ (r.waiting)
+            r.steps = executed;
             return r;
         }
+        executed += r.steps;
     }
     r.ok = false;
     r.error = "Exceeded maxSteps";
+    r.steps = executed;
+    r.faultIp = m_ip;
     return r;
 }
 
 Result VM::step() {
+    Result r = exec();
+    if (!r.ok) {
+        r.faultIp = m_insnIp;
+        if (m_traceFile && !m_trace.empty()) {
+            flushOutput();
+            dumpTrace(m_traceFile);
+            std::fprintf(m_traceFile, "fault at 0x%04x: %s\n", m_insnIp, r.error.c_str());
+        }
+    }
+    return r;
+}
+
+Result VM::exec() {
     Result r{};
+    if (m_halted) return r;
+    // Pending lines that are masked or can't nest stay pending without slowing every step.
+    if (m_waiting || (!m_inIrq && (m_irqPending.load(std::memory_order_relaxed) &
+                                   static_cast<u32>(m_mem[IRQ_ENABLE_ADDR])) != 0)) {
+        if (!serviceIrq(r)) return r;
+        if (m_waiting) { r.waiting = true; return r; }
+    }
+
+    if (m_gasPending && !chargeGas(r)) return r;
+
+    m_insnIp = m_ip;
     u32 opCell;
     if (!fetchCell(opCell)) { r.ok = false; r.error = "IP out of range"; return r; }
+    if (!m_trace.empty()) {
+        TraceEntry& t = m_trace[m_traceCount++ & (m_trace.size() - 1)];
+        t.ip = m_insnIp;
+        t.op = opCell;
+        t.tos = m_sp > m_stackLo ? m_mem[m_sp - 1] : 0;
+    }
+    if (m_profileInterval && --m_profileCountdown == 0) sampleProfile();
     Op op = static_cast<Op>(opCell);
     r.steps = 1;
 
@@ -92,8 +766,79 @@ Result VM::step() {
 
     switch (op) {
         case Op::HALT:
+            if (m_thread != 0) { finishThread(r); return r; }
+            flushOutput();
+            m_halted = true;
             r.steps = 0;
             return r;
+        case Op::HALT_UNTIL_IRQ:
+            if (m_coreId != 0) { r.ok = false; r.error = "HALT_UNTIL_IRQ on a secondary core"; return r; }
+            flushOutput();
+            m_waiting = true;
+            r.waiting = true;
+            r.steps = 0;
+            return r;
+        case Op::RETI:
+            if (!m_inIrq) { r.ok = false; r.error = "RETI outside interrupt handler"; return r; }
+            if (!pop(a)) { r.ok = false; r.error = "Stack underflow (RETI)"; return r; }
+            if (static_cast<u32>(a) >= MEM_SIZE) { r.ok = false; r.error = "RETI out of range"; return r; }
+            m_ip = static_cast<u32>(a);
+            m_inIrq = false;
+            enterRun();
+            return r;
+        case Op::SPAWN: {
+            u32 addr;
+            if (!fetchCell(addr)) { r.ok = false; r.error = "Truncated SPAWN"; return r; }
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "SPAWN out of range"; return r; }
+            if (m_coreId != 0) { r.ok = false; r.error = "SPAWN on a secondary core"; return r; }
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (SPAWN)"; return r; }
+            if (stackLimit() > THREAD_TCB_BASE) { r.ok = false; r.error = "SPAWN needs the main stack to end below THREAD_TCB_BASE"; return r; }
+            u32 id = 1;
+            while (id < THREAD_SLOTS && tcb(id, TCB_STATE) != THREAD_FREE) ++id;
+            if (id == THREAD_SLOTS) { m_mem[m_sp - 1] = 0; return r; }
+            const u32 base = THREAD_STACK_BASE + (id - 1) * THREAD_STACK_CELLS;
+            m_mem[base] = m_mem[m_sp - 1];
+            tcb(id, TCB_IP) = static_cast<i32>(addr);
+            tcb(id, TCB_SP) = static_cast<i32>(base + 1);
+            tcb(id, TCB_STATE) = THREAD_READY;
+            tcb(id, TCB_JOINER) = 0;
+            tcb(id, TCB_RESULT) = 0;
+            linkBefore(id, m_thread); // runs after every thread already in the ring
+            m_mem[m_sp - 1] = static_cast<i32>(id);
+            return r;
+        }
+        case Op::YIELD: {
+            if (m_inIrq) { r.ok = false; r.error = "YIELD in interrupt handler"; return r; }
+            if (m_coreId != 0) { r.ok = false; r.error = "YIELD on a secondary core"; return r; }
+            const u32 next = link(m_thread, TCB_NEXT);
+            if (next != m_thread && !switchTo(next, true, r)) return r;
+            enterRun();
+            return r;
+        }
+        case Op::JOIN: {
+            if (m_inIrq) { r.ok = false; r.error = "JOIN in interrupt handler"; return r; }
+            if (m_coreId != 0) { r.ok = false; r.error = "JOIN on a secondary core"; return r; }
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (JOIN)"; return r; }
+            const u32 id = static_cast<u32>(m_mem[m_sp - 1]);
+            if (id == 0 || id >= THREAD_SLOTS || id == m_thread || tcb(id, TCB_STATE) == THREAD_FREE) {
+                r.ok = false; r.error = "JOIN on an invalid thread"; return r;
+            }
+            if (tcb(id, TCB_STATE) == THREAD_DONE) {
+                m_mem[m_sp - 1] = tcb(id, TCB_RESULT);
+                tcb(id, TCB_STATE) = THREAD_FREE;
+                enterRun();
+                return r;
+            }
+            if (tcb(id, TCB_JOINER) != 0) { r.ok = false; r.error = "JOIN on a thread that already has a joiner"; return r; }
+            const u32 next = link(m_thread, TCB_NEXT);
+            if (next == m_thread) { r.ok = false; r.error = "Deadlock: no other thread is ready"; return r; }
+            --m_sp; // the result is pushed here when the thread finishes
+            tcb(id, TCB_JOINER) = static_cast<i32>(m_thread + 1);
+            tcb(m_thread, TCB_STATE) = THREAD_BLOCKED;
+            unlink(m_thread);
+            switchTo(next, true, r);
+            return r;
+        }
         case Op::PUSHI: {
             u32 imm;
             if (!fetchCell(imm)) { r.ok = false; r.error = "Truncated PUSHI"; return r; }
@@ -108,11 +853,11 @@ Result VM::step() {
             if (!push(a) || !push(a)) { r.ok = false; r.error = "Stack overflow (DUP)"; }
             return r;
         case Op::SWAP:
-            if (m_sp - STACK_BASE < 2) { r.ok = false; r.error = "Stack underflow (SWAP)"; return r; }
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (SWAP)"; return r; }
             std::swap(m_mem[m_sp - 1], m_mem[m_sp - 2]);
             return r;
         case Op::NEG:
-            if (m_sp <= STACK_BASE) { r.ok = false; r.error = "Stack underflow (NEG)"; return r; }
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (NEG)"; return r; }
             m_mem[m_sp - 1] = -m_mem[m_sp - 1];
             return r;
         case Op::OVER: {
@@ -125,8 +870,21 @@ Result VM::step() {
         case Op::SUB:
         case Op::MUL:
         case Op::DIV:
-        case Op::MOD: {
-            if (!pop(b) || !pop(a)) { r.ok = false; r.error = "Stack underflow (arith)"; return r; }
+        case Op::MOD:
+        case Op::DIVU:
+        case Op::MODU:
+        case Op::AND:
+        case Op::OR:
+        case Op::XOR:
+        case Op::SHL:
+        case Op::SHR:
+        case Op::SAR: {
+            // Binary ops replace the second stack item in place and drop the top.
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (arith)"; return r; }
+            a = m_mem[m_sp - 2];
+            b = m_mem[m_sp - 1];
+            const u32 ua = static_cast<u32>(a);
+            const u32 ub = static_cast<u32>(b);
             i32 res = 0;
             switch (op) {
                 case Op::ADD: res = a + b; break;
@@ -134,35 +892,179 @@ Result VM::step() {
                 case Op::MUL: res = a * b; break;
                 case Op::DIV:
                     if (b == 0) { r.ok = false; r.error = "Division by zero"; return r; }
-                    res = a / b; break;
+                    res = b == -1 ? static_cast<i32>(0u - ua) : a / b; break; // INT32_MIN / -1 wraps like NEG
                 case Op::MOD:
                     if (b == 0) { r.ok = false; r.error = "Modulo by zero"; return r; }
-                    res = a % b; break;
+                    res = b == -1 ? 0 : a % b; break;
+                case Op::DIVU:
+                    if (ub == 0) { r.ok = false; r.error = "Division by zero"; return r; }
+                    res = static_cast<i32>(ua / ub); break;
+                case Op::MODU:
+                    if (ub == 0) { r.ok = false; r.error = "Modulo by zero"; return r; }
+                    res = static_cast<i32>(ua % ub); break;
+                case Op::AND: res = a & b; break;
+                case Op::OR:  res = a | b; break;
+                case Op::XOR: res = a ^ b; break;
+                case Op::SHL: res = static_cast<i32>(ua << (ub & 31u)); break;
+                case Op::SHR: res = static_cast<i32>(ua >> (ub & 31u)); break;
+                case Op::SAR: res = a >> (ub & 31u); break;
+                default: break;
+            }
+            m_mem[m_sp - 2] = res;
+            --m_sp;
+            return r;
+        }
+        case Op::NOT:
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (NOT)"; return r; }
+            m_mem[m_sp - 1] = ~m_mem[m_sp - 1];
+            return r;
+        case Op::LERP8X4: {
+            if (m_sp - m_stackLo < 3) { r.ok = false; r.error = "Stack underflow (LERP8X4)"; return r; }
+            const i32 t = m_mem[m_sp - 1];
+            const u32 wb = static_cast<u32>(t < 0 ? 0 : (t > 256 ? 256 : t));
+            m_mem[m_sp - 3] = static_cast<i32>(lanes::lerp8x4(static_cast<u32>(m_mem[m_sp - 3]),
+                                                              static_cast<u32>(m_mem[m_sp - 2]), wb));
+            m_sp -= 2;
+            return r;
+        }
+        case Op::VADD8:
+        case Op::VADDS8:
+        case Op::VSUBS8:
+        case Op::VMUL8:
+        case Op::VMIN8:
+        case Op::VMAX8:
+        case Op::VAVG8:
+        case Op::VADD16:
+        case Op::VADDS16:
+        case Op::VSUBS16:
+        case Op::VMUL16:
+        case Op::VMIN16:
+        case Op::VMAX16:
+        case Op::VAVG16: {
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (packed)"; return r; }
+            const u32 ua = static_cast<u32>(m_mem[m_sp - 2]);
+            const u32 ub = static_cast<u32>(m_mem[m_sp - 1]);
+            u32 res = 0;
+            switch (op) {
+                case Op::VADD8:   res = lanes::add<8>(ua, ub); break;
+                case Op::VADDS8:  res = lanes::addSat<8>(ua, ub); break;
+                case Op::VSUBS8:  res = lanes::subSat<8>(ua, ub); break;
+                case Op::VMUL8:   res = lanes::mul8(ua, ub); break;
+                case Op::VMIN8:   res = lanes::min<8>(ua, ub); break;
+                case Op::VMAX8:   res = lanes::max<8>(ua, ub); break;
+                case Op::VAVG8:   res = lanes::avg<8>(ua, ub); break;
+                case Op::VADD16:  res = lanes::add<16>(ua, ub); break;
+                case Op::VADDS16: res = lanes::addSat<16>(ua, ub); break;
+                case Op::VSUBS16: res = lanes::subSat<16>(ua, ub); break;
+                case Op::VMUL16:  res = lanes::mul16(ua, ub); break;
+                case Op::VMIN16:  res = lanes::min<16>(ua, ub); break;
+                case Op::VMAX16:  res = lanes::max<16>(ua, ub); break;
+                case Op::VAVG16:  res = lanes::avg<16>(ua, ub); break;
+                default: break;
+            }
+            m_mem[m_sp - 2] = static_cast<i32>(res);
+            --m_sp;
+            return r;
+        }
+        case Op::FADD:
+        case Op::FSUB:
+        case Op::FMUL:
+        case Op::FDIV:
+        case Op::FCMP: {
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (float)"; return r; }
+            const float fa = cellToF32(m_mem[m_sp - 2]);
+            const float fb = cellToF32(m_mem[m_sp - 1]);
+            i32 res = 0;
+            switch (op) {
+                case Op::FADD: res = f32ToCell(fa + fb); break;
+                case Op::FSUB: res = f32ToCell(fa - fb); break;
+                case Op::FMUL: res = f32ToCell(fa * fb); break;
+                case Op::FDIV: res = f32ToCell(fa / fb); break;
+                case Op::FCMP: res = (fa < fb) ? -1 : (fa > fb) ? 1 : (fa == fb) ? 0 : 2; break;
                 default: break;
             }
-            if (!push(res)) { r.ok = false; r.error = "Stack overflow (arith)"; }
+            m_mem[m_sp - 2] = res;
+            --m_sp;
+            return r;
+        }
+        case Op::FNEG:
+        case Op::FSQRT:
+        case Op::ITOF:
+        case Op::FTOI: {
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (float)"; return r; }
+            i32& top = m_mem[m_sp - 1];
+            switch (op) {
+                case Op::FNEG:  top ^= static_cast<i32>(0x80000000u); break;
+                case Op::FSQRT: top = f32ToCell(std::sqrt(cellToF32(top))); break;
+                case Op::ITOF:  top = f32ToCell(static_cast<float>(top)); break;
+                case Op::FTOI: {
+                    const float f = cellToF32(top);
+                    if (std::isnan(f)) top = 0;
+                    else if (f >= 2147483648.0f) top = 0x7FFFFFFF;
+                    else if (f <= -2147483648.0f) top = static_cast<i32>(0x80000000u);
+                    else top = static_cast<i32>(f);
+                    break;
+                }
+                default: break;
+            }
+            return r;
+        }
+        case Op::FXMUL:
+        case Op::FXDIV: {
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (fixed)"; return r; }
+            const std::int64_t xa = m_mem[m_sp - 2];
+            const std::int64_t xb = m_mem[m_sp - 1];
+            std::int64_t res = 0;
+            if (op == Op::FXMUL) {
+                res = (xa * xb) >> 16;
+            } else {
+                if (xb == 0) { r.ok = false; r.error = "Division by zero"; return r; }
+                res = (xa * 65536) / xb;
+            }
+            m_mem[m_sp - 2] = static_cast<i32>(static_cast<u32>(res));
+            --m_sp;
             return r;
         }
         case Op::CMP_EQ:
         case Op::CMP_LT:
-        case Op::CMP_GT: {
+        case Op::CMP_GT:
+        case Op::CMP_LTU: {
             if (!pop(b) || !pop(a)) { r.ok = false; r.error = "Stack underflow (cmp)"; return r; }
             i32 res = 0;
             if (op == Op::CMP_EQ) res = (a == b) ? 1 : 0;
             else if (op == Op::CMP_LT) res = (a < b) ? 1 : 0;
             else if (op == Op::CMP_GT) res = (a > b) ? 1 : 0;
+            else if (op == Op::CMP_LTU) res = (static_cast<u32>(a) < static_cast<u32>(b)) ? 1 : 0;
             if (!push(res)) { r.ok = false; r.error = "Stack overflow (cmp)"; }
             return r;
         }
         case Op::PRINT:
             if (!pop(a)) { r.ok = false; r.error = "Stack underflow (PRINT)"; return r; }
-            std::printf("%d\n", a);
+            {
+                char buf[16];
+                char* end = std::to_chars(buf, buf + sizeof(buf) - 1, a).ptr;
+                *end++ = '\n';
+                m_out.append(buf, end);
+            }
+            if (m_out.size() >= OUT_BUFFER_SIZE) flushOutput();
+            return r;
+        case Op::SYSCALL: {
+            u32 n;
+            if (!fetchCell(n)) { r.ok = false; r.error = "Truncated SYSCALL"; return r; }
+            if (n >= m_syscalls.size() || !m_syscalls[n].fn) { r.ok = false; r.error = "SYSCALL not registered"; return r; }
+            const Syscall& sc = m_syscalls[n];
+            if (m_sp - m_stackLo < sc.arity) { r.ok = false; r.error = "Stack underflow (SYSCALL)"; return r; }
+            const u32 base = m_sp - sc.arity;
+            if (sc.results > sc.arity && base + sc.results > m_stackHi) { r.ok = false; r.error = "Stack overflow (SYSCALL)"; return r; }
+            if (!sc.fn(*this, &m_mem[base], sc.user)) { r.ok = false; r.error = std::string("SYSCALL failed: ") + (sc.name ? sc.name : std::to_string(n)); return r; }
+            m_sp = base + sc.results;
             return r;
+        }
         case Op::LOAD: {
             u32 addr;
             if (!fetchCell(addr)) { r.ok = false; r.error = "Truncated LOAD"; return r; }
             if (addr >= m_mem.size()) { r.ok = false; r.error = "LOAD out of range"; return r; }
-            if (!push(m_mem[addr])) { r.ok = false; r.error = "Stack overflow (LOAD)"; }
+            if (!push(loadCell(addr))) { r.ok = false; r.error = "Stack overflow (LOAD)"; }
             return r;
         }
         case Op::STORE: {
@@ -170,7 +1072,7 @@ Result VM::step() {
             if (!fetchCell(addr)) { r.ok = false; r.error = "Truncated STORE"; return r; }
             if (addr >= m_mem.size()) { r.ok = false; r.error = "STORE out of range"; return r; }
             if (!pop(a)) { r.ok = false; r.error = "Stack underflow (STORE)"; return r; }
-            m_mem[addr] = a;
+            storeCell(addr, a);
             return r;
         }
         case Op::STORE_IND: {
@@ -179,7 +1081,106 @@ Result VM::step() {
             if (!pop(a)) { r.ok = false; r.error = "Stack underflow (STORE_IND value)"; return r; }
             const u32 addr = static_cast<u32>(addrI32);
             if (addr >= m_mem.size()) { r.ok = false; r.error = "STORE_IND out of range"; return r; }
-            m_mem[addr] = a;
+            storeCell(addr, a);
+            return r;
+        }
+        case Op::LOAD_IND: {
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (LOAD_IND)"; return r; }
+            const u32 addr = static_cast<u32>(m_mem[m_sp - 1]);
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "LOAD_IND out of range"; return r; }
+            m_mem[m_sp - 1] = loadCell(addr);
+            return r;
+        }
+        case Op::LOAD_IDX: {
+            u32 base;
+            if (!fetchCell(base)) { r.ok = false; r.error = "Truncated LOAD_IDX"; return r; }
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (LOAD_IDX)"; return r; }
+            const u32 addr = base + static_cast<u32>(m_mem[m_sp - 1]);
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "LOAD_IDX out of range"; return r; }
+            m_mem[m_sp - 1] = loadCell(addr);
+            return r;
+        }
+        case Op::STORE_IDX: {
+            u32 base;
+            if (!fetchCell(base)) { r.ok = false; r.error = "Truncated STORE_IDX"; return r; }
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (STORE_IDX)"; return r; }
+            const u32 addr = base + static_cast<u32>(m_mem[m_sp - 1]);
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "STORE_IDX out of range"; return r; }
+            storeCell(addr, m_mem[m_sp - 2]);
+            m_sp -= 2;
+            return r;
+        }
+        case Op::LOAD_ACQ: {
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (LOAD_ACQ)"; return r; }
+            const u32 addr = static_cast<u32>(m_mem[m_sp - 1]);
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "LOAD_ACQ out of range"; return r; }
+            m_mem[m_sp - 1] = addr == CORE_ID_ADDR ? static_cast<i32>(m_coreId) : atomics::loadAcquire(&m_mem[addr]);
+            return r;
+        }
+        case Op::STORE_REL: {
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (STORE_REL)"; return r; }
+            const u32 addr = static_cast<u32>(m_mem[m_sp - 1]);
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "STORE_REL out of range"; return r; }
+            if (addr == BARRIER_ADDR) arriveAtBarrier();
+            else atomics::storeRelease(&m_mem[addr], m_mem[m_sp - 2]);
+            markDirty(addr);
+            if (addr == DMA_CTRL_ADDR) controlDma(static_cast<u32>(m_mem[m_sp - 2]));
+            m_sp -= 2;
+            return r;
+        }
+        case Op::CAS: {
+            if (m_sp - m_stackLo < 3) { r.ok = false; r.error = "Stack underflow (CAS)"; return r; }
+            const u32 addr = static_cast<u32>(m_mem[m_sp - 1]);
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "CAS out of range"; return r; }
+            m_mem[m_sp - 3] = atomics::compareExchange(&m_mem[addr], m_mem[m_sp - 2], m_mem[m_sp - 3]);
+            markDirty(addr);
+            m_sp -= 2;
+            return r;
+        }
+        case Op::XADD: {
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (XADD)"; return r; }
+            const u32 addr = static_cast<u32>(m_mem[m_sp - 1]);
+            if (addr >= MEM_SIZE) { r.ok = false; r.error = "XADD out of range"; return r; }
+            m_mem[m_sp - 2] = atomics::fetchAdd(&m_mem[addr], m_mem[m_sp - 2]);
+            markDirty(addr);
+            --m_sp;
+            return r;
+        }
+        case Op::ALLOC: {
+            if (m_coreId != 0) { r.ok = false; r.error = "ALLOC on a secondary core"; return r; }
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (ALLOC)"; return r; }
+            u32 p = 0;
+            if (const char* err = m_heap.alloc(m_mem.data(), static_cast<u32>(m_mem[m_sp - 1]), p)) { r.ok = false; r.error = err; return r; }
+            m_mem[m_sp - 1] = static_cast<i32>(p);
+            m_dirtyPages |= m_heapPages;
+            return r;
+        }
+        case Op::FREE: {
+            if (m_coreId != 0) { r.ok = false; r.error = "FREE on a secondary core"; return r; }
+            if (m_sp <= m_stackLo) { r.ok = false; r.error = "Stack underflow (FREE)"; return r; }
+            if (const char* err = m_heap.free(m_mem.data(), static_cast<u32>(m_mem[m_sp - 1]))) { r.ok = false; r.error = err; return r; }
+            --m_sp;
+            m_dirtyPages |= m_heapPages;
+            return r;
+        }
+        case Op::REALLOC: {
+            if (m_coreId != 0) { r.ok = false; r.error = "REALLOC on a secondary core"; return r; }
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (REALLOC)"; return r; }
+            u32 p = 0;
+            const u32 old = static_cast<u32>(m_mem[m_sp - 2]);
+            if (const char* err = m_heap.realloc(m_mem.data(), old, static_cast<u32>(m_mem[m_sp - 1]), p)) { r.ok = false; r.error = err; return r; }
+            m_mem[m_sp - 2] = static_cast<i32>(p);
+            --m_sp;
+            m_dirtyPages |= m_heapPages;
+            return r;
+        }
+        case Op::FB_XY: {
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (FB_XY)"; return r; }
+            const u32 y = static_cast<u32>(m_mem[m_sp - 1]);
+            const u32 x = static_cast<u32>(m_mem[m_sp - 2]);
+            if (x >= FB_WIDTH || y >= FB_HEIGHT) { r.ok = false; r.error = "FB_XY out of range"; return r; }
+            m_mem[m_sp - 2] = static_cast<i32>(FB_BASE + y * FB_WIDTH + x);
+            --m_sp;
             return r;
         }
         case Op::JMP: {
@@ -187,6 +1188,7 @@ Result VM::step() {
             if (!fetchCell(addr)) { r.ok = false; r.error = "Truncated JMP"; return r; }
             if (addr >= MEM_SIZE) { r.ok = false; r.error = "JMP out of range"; return r; }
             m_ip = addr;
+            enterRun();
             return r;
         }
         case Op::JZ:
@@ -199,6 +1201,42 @@ Result VM::step() {
                 if (addr >= MEM_SIZE) { r.ok = false; r.error = "Jump out of range"; return r; }
                 m_ip = addr;
             }
+            enterRun();
+            return r;
+        }
+        case Op::JEQ:
+        case Op::JNE:
+        case Op::JLT:
+        case Op::JLE:
+        case Op::JGT:
+        case Op::JGE: {
+            u32 addr;
+            if (!fetchCell(addr)) { r.ok = false; r.error = "Truncated Jcc"; return r; }
+            if (m_sp - m_stackLo < 2) { r.ok = false; r.error = "Stack underflow (Jcc)"; return r; }
+            a = m_mem[m_sp - 2];
+            b = m_mem[m_sp - 1];
+            m_sp -= 2;
+            if (branchTaken(op, a, b)) {
+                if (addr >= MEM_SIZE) { r.ok = false; r.error = "Jump out of range"; return r; }
+                m_ip = addr;
+            }
+            enterRun();
+            return r;
+        }
+        case Op::JEQ_IMM:
+        case Op::JNE_IMM:
+        case Op::JLT_IMM:
+        case Op::JLE_IMM:
+        case Op::JGT_IMM:
+        case Op::JGE_IMM: {
+            u32 imm, addr;
+            if (!fetchCell(imm) || !fetchCell(addr)) { r.ok = false; r.error = "Truncated Jcc_IMM"; return r; }
+            if (!pop(a)) { r.ok = false; r.error = "Stack underflow (Jcc_IMM)"; return r; }
+            if (branchTaken(op, a, static_cast<i32>(imm))) {
+                if (addr >= MEM_SIZE) { r.ok = false; r.error = "Jump out of range"; return r; }
+                m_ip = addr;
+            }
+            enterRun();
             return r;
         }
         default:
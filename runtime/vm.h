@@ -1,22 +1,70 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <cstdio>
+#include <memory>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 #include "../bytecode/opcodes.h"
+#include "gas.h"
+#include "heap.h"
+#include "snapshot.h"
+
+struct LjAotProgram; // aot_abi.h
 
 namespace vm32 {
 
+class VM;
+class CoreBarrier;
+class RegisterProgram;
+class DmaChannel;
+
+// Native function exposed to bytecode through SYSCALL n. `args` points straight
+// into the VM stack at the deepest of the `arity` arguments; results are written
+// back over args[0..results) and the VM then adjusts sp. Return false to fault.
+using SyscallFn = bool (*)(VM& vm, i32* args, void* user);
+
+struct Syscall {
+    const char* name{nullptr};
+    u8 arity{0};
+    u8 results{0};
+    SyscallFn fn{nullptr};
+    void* user{nullptr};
+};
+
 struct Result {
     bool ok{true};
     std::string error;
-    std::size_t steps{0};
+    std::size_t steps{0}; // instructions executed; run() reports the total
+    bool waiting{false}; // parked in HALT_UNTIL_IRQ; call run() again after raiseIrq()
+    u32 faultIp{0};      // on error: address of the failing instruction
+    bool outOfGas{false}; // stopped before a run of code the gas budget cannot cover
+};
+
+// One executed instruction in the VM's trace ring (see VM::enableTrace()).
+struct TraceEntry {
+    u32 ip;  // address of the opcode cell
+    u32 op;  // opcode cell
+    i32 tos; // top of stack before the instruction (0 if empty)
+};
+
+// Instructions seen by the sampling profiler at one site (see VM::enableProfiler()).
+struct ProfileSample {
+    u32 ip;            // sampled instruction
+    bool inIrq;        // sampled inside an interrupt handler
+    u32 irqFrom;       // with inIrq: the ip the handler interrupted
+    std::uint64_t count;
 };
 
 class VM {
 public:
     explicit VM(std::size_t stackCapacity = 1024);
+    ~VM();
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
 
     void load(const std::vector<u32>& codeCells);
     void reset();
@@ -26,13 +74,133 @@ public:
 
     u32 ip() const { return m_ip; }
     u32 sp() const { return m_sp; }
+    bool halted() const { return m_halted; }
+    bool waiting() const { return m_waiting; }
     std::size_t memSize() const { return m_mem.size(); }
     i32 memAt(u32 addr) const { return m_mem.at(addr); }
+    const i32* memData() const { return m_mem.data(); } // MEM_SIZE cells, for bulk host reads
+
+    // Bulk host write (assets at load time). Fails, writing nothing, if the
+    // range leaves memory or touches the I/O page.
+    bool writeMem(u32 addr, const i32* cells, std::size_t count, std::string* outError = nullptr);
 
     // Host-side I/O helpers (for SDL / embedding)
-    void setKeyboardState(u32 mask);
+    void setKeyboardState(u32 mask);   // raises IRQ_KEY when the mask changes
     u32 keyboardState() const;
 
+    // Append a key event to the memory-mapped event queue and raise IRQ_KEY.
+    // Returns false (event dropped) when the queue is full.
+    bool pushInputEvent(u32 type, u32 scancode, u32 timestampMs);
+
+    // Copy up to maxSamples queued audio samples out of the audio ring and
+    // advance AUD_RPTR_ADDR. Returns the number of samples copied.
+    std::size_t readAudio(std::int16_t* out, std::size_t maxSamples);
+
+    // Flag interrupt line `line` as pending. Safe to call from any host thread;
+    // it is delivered at the next instruction boundary if enabled in IRQ_ENABLE_ADDR.
+    void raiseIrq(u32 line);
+
+    // Console output. PRINT and drainConsole() append to a per-VM buffer that is
+    // written to the output stream in bulk: when it fills, at HALT, on error,
+    // and whenever the host calls flushOutput() (e.g. once per frame).
+    void setOutput(std::FILE* out) { flushOutput(); m_outFile = out; }
+    void flushOutput();
+
+    // Host function table for SYSCALL n (n < MAX_SYSCALLS). Registering over an
+    // existing entry replaces it; returns false if n is out of range or fn is null.
+    bool registerSyscall(u32 n, const Syscall& sc);
+
+    // Host data for DMA_FROM_BLOB transfers, by id (id < MAX_DMA_BLOBS).
+    // Setting over an existing blob replaces it and null removes it; returns
+    // false if id is out of range. A transfer in flight keeps its blob alive.
+    bool setDmaBlob(u32 id, std::shared_ptr<const std::vector<i32>> cells);
+    // Complete each transfer inside its DMA_START store instead of on the
+    // worker thread, so DMA_DONE and IRQ_DMA land at a point that does not
+    // depend on host timing. Input recording and replay need this.
+    void setDmaSynchronous(bool on);
+
+    // Copy the text console rows up to CON_CURSOR_ADDR into the output buffer,
+    // then clear those cells and reset the cursor to 0.
+    void drainConsole();
+
+    // Save states. snapshot() copies only the pages written since this VM's last
+    // snapshot() or restore() and shares the rest with that snapshot; restore()
+    // copies back only the pages that may differ. Host configuration (syscalls,
+    // output stream, stack capacity) and buffered output are not part of the state.
+    Snapshot snapshot();
+    void restore(const Snapshot& snap);
+
+    // New VM with this VM's current state, host configuration included. The two
+    // share snapshot pages, so later snapshots of either stay incremental.
+    std::unique_ptr<VM> fork();
+
+    // Cores 1..count-1 for a multi-core run (see CORE_ID_ADDR and runCores()):
+    // VMs that share this VM's memory and host configuration and start at its ip
+    // with empty stacks. This VM becomes core 0 until releaseCores(). While the
+    // cores exist the pages they write are not tracked, so the next snapshot()
+    // copies every page. With gas metering on, all cores draw on this VM's
+    // budget; releaseCores() leaves what remains in gas().
+    bool makeCores(u32 count, std::vector<std::unique_ptr<VM>>& out, std::string* outError = nullptr);
+    void releaseCores();
+    u32 coreId() const { return m_coreId; }
+    std::shared_ptr<CoreBarrier> coreBarrier() const { return m_barrier; }
+
+    // Execution trace: keep the last `entries` instructions (rounded up to a
+    // power of two; 0 turns tracing off). When a step fails, the trace is
+    // disassembled to the trace stream (stderr unless set, null for none).
+    void enableTrace(std::size_t entries);
+    void setTraceOutput(std::FILE* out) { m_traceFile = out; }
+    void dumpTrace(std::FILE* out) const; // oldest instruction first
+
+    // Sampling profiler: every `intervalSteps` instructions the current
+    // instruction is counted. 0 turns it off; enabling clears earlier samples.
+    void enableProfiler(u32 intervalSteps);
+    u32 profileInterval() const { return m_profileInterval; }
+    std::vector<ProfileSample> profileSamples() const;
+
+    // Gas metering (off by default). Entering a straight-line run of code (at a
+    // jump target, after a conditional branch, on interrupt entry and RETI)
+    // charges the whole run up to its next branch, from a table built by load().
+    // When the budget cannot cover a run, step() stops before it with
+    // Result::outOfGas; addGas() and run() again to continue. Interrupt delivery
+    // refunds the part of the run not executed. While metering, entering code the
+    // table does not cover (data, mid-instruction, cells past the loaded program)
+    // is an error; the table is not updated for code the program writes itself.
+    void setGasSchedule(const GasSchedule& schedule);
+    void setGas(std::uint64_t gas); // turns metering on
+    void addGas(std::uint64_t gas) {
+        if (m_sharedGas) m_sharedGas->fetch_add(gas, std::memory_order_relaxed);
+        else m_gas += gas;
+    }
+    void disableGas() { m_gasOn = false; m_gasPending = false; }
+    std::uint64_t gas() const { return m_sharedGas ? m_sharedGas->load(std::memory_order_relaxed) : m_gas; }
+
+    // Native code translated ahead of time by the aot tool (see aot_abi.h).
+    // attachNative() checks that `program` was built from the loaded program;
+    // run() then executes it natively from its entry points, stepping the
+    // interpreter for whatever it hands back, while gas, tracing and the
+    // profiler are off and no cores are running. Results, step counts and
+    // faults match the interpreter; interrupts raised from another thread are
+    // taken up to NATIVE_SLICE instructions late, and the next snapshot()
+    // after a native run compares every page. load() and reset() detach; the
+    // module must stay loaded while attached.
+    bool attachNative(const LjAotProgram* program, std::string* outError = nullptr);
+    void detachNative() { m_native = nullptr; m_nativeEntry.clear(); }
+    bool nativeAttached() const { return m_native != nullptr; }
+
+    // Register IR (see register_ir.h). While on, load() also translates the
+    // program into register code, which run() uses like a native module when
+    // none is attached; turning it on translates the loaded program now.
+    void setRegisterIr(bool on);
+    bool registerIr() const { return m_regIrOn; }
+
+    // Heap for ALLOC, FREE and REALLOC (see heap.h), HEAP_CELLS at HEAP_BASE
+    // unless moved. setHeapRegion() takes any region clear of the I/O page and
+    // empties it there; reset() and load() empty it too. The region is part of
+    // the host configuration, the heap's contents part of memory.
+    bool setHeapRegion(u32 base, u32 cells, std::string* outError = nullptr);
+    bool heapStats(HeapStats& out, std::string* outError = nullptr) const;
+
     // Public memory layout constants (cell addresses)
     static constexpr u32 MEM_SIZE  = 0x10000;        // cells
     static constexpr u32 CODE_BASE = 0x00000;       // base of code region
@@ -48,7 +216,7 @@ public:
 
     // Memory-mapped input registers (read by VM bytecode via LOAD)
     // Layout: a small I/O page immediately below the framebuffer.
-    static constexpr u32 IO_SIZE = 16;                // cells
+    static constexpr u32 IO_SIZE = 64;                // cells
     static constexpr u32 IO_BASE = FB_BASE - IO_SIZE; // base cell address of I/O page
 
     // Keyboard/gamepad-style bitmask register
@@ -69,16 +237,294 @@ public:
     static constexpr u32 KB_SELECT = 1u << 10;
     static constexpr u32 KB_START  = 1u << 11;
 
+    // Interrupt controller. Setting bit n of IRQ_ENABLE_ADDR enables line n;
+    // IRQ_VEC_BASE + n holds its handler address (0 = no handler, the interrupt
+    // only wakes HALT_UNTIL_IRQ). On delivery the return ip is pushed, IRQ_CAUSE_ADDR
+    // is set to the line and further interrupts are held until RETI. The lowest
+    // pending line wins. TIMER_PERIOD_ADDR is the interval in ms at which the host
+    // raises IRQ_TIMER (0 = off).
+    static constexpr u32 IRQ_ENABLE_ADDR   = IO_BASE + 2;
+    static constexpr u32 IRQ_CAUSE_ADDR    = IO_BASE + 3;
+    static constexpr u32 TIMER_PERIOD_ADDR = IO_BASE + 4;
+    static constexpr u32 IRQ_VEC_BASE      = IO_BASE + 8;
+    static constexpr u32 IRQ_LINES         = 8;
+
+    static constexpr u32 IRQ_VBLANK = 0;
+    static constexpr u32 IRQ_TIMER  = 1;
+    static constexpr u32 IRQ_KEY    = 2;
+    static constexpr u32 IRQ_DMA    = 3; // transfer finished (see DMA_CTRL_ADDR)
+
+    // Memory-mapped text console: CON_COLS x CON_ROWS character cells (low 8 bits
+    // of each cell) directly below the I/O page. CON_CURSOR_ADDR holds the index
+    // of the next cell to write; the host drains everything before it.
+    static constexpr u32 CON_CURSOR_ADDR = IO_BASE + 1;
+    static constexpr u32 CON_COLS = 32;
+    static constexpr u32 CON_ROWS = 24;
+    static constexpr u32 CON_SIZE = CON_COLS * CON_ROWS; // cells
+    static constexpr u32 CON_BASE = IO_BASE - CON_SIZE;
+
+    static constexpr u32 MAX_SYSCALLS = 256;
+
+    // Input event queue: a ring of EVQ_CAPACITY entries below the text console.
+    // The host advances EVQ_HEAD_ADDR after writing an entry; the program reads
+    // entries at EVQ_TAIL_ADDR and advances it. Indices wrap at EVQ_CAPACITY and
+    // the queue is empty when head == tail. Each entry is two cells:
+    //   +0: (type << 16) | SDL scancode   +1: timestamp in ms
+    static constexpr u32 EVQ_HEAD_ADDR   = IO_BASE + 16;
+    static constexpr u32 EVQ_TAIL_ADDR   = IO_BASE + 17;
+    static constexpr u32 EVQ_CAPACITY    = 64; // entries (power of two)
+    static constexpr u32 EVQ_ENTRY_CELLS = 2;
+    static constexpr u32 EVQ_SIZE = EVQ_CAPACITY * EVQ_ENTRY_CELLS; // cells
+    static constexpr u32 EVQ_BASE = CON_BASE - EVQ_SIZE;
+
+    static constexpr u32 EV_KEY_DOWN = 1;
+    static constexpr u32 EV_KEY_UP   = 2;
+
+    // Audio output: a ring of AUD_CAPACITY mono signed 16-bit samples (low 16 bits
+    // of each cell) at AUDIO_RATE Hz, below the event queue. The program writes
+    // samples at AUD_WPTR_ADDR and advances it; the host consumes from
+    // AUD_RPTR_ADDR. Indices wrap at AUD_CAPACITY; empty when equal, and the
+    // program may write (rptr - wptr - 1) & (AUD_CAPACITY - 1) samples.
+    static constexpr u32 AUD_WPTR_ADDR = IO_BASE + 18;
+    static constexpr u32 AUD_RPTR_ADDR = IO_BASE + 19;
+    static constexpr u32 AUD_CAPACITY  = 1024; // samples (power of two)
+    static constexpr u32 AUD_SIZE = AUD_CAPACITY; // cells
+    static constexpr u32 AUD_BASE = EVQ_BASE - AUD_SIZE;
+    static constexpr u32 AUDIO_RATE = 22050;
+
+    // Tile/sprite video device, composited over the framebuffer by the host at
+    // present time (see video.h). Colour index 0 is transparent everywhere.
+    //   PAL_BASE:   256 ARGB8888 palette entries
+    //   SPR_BASE:   SPR_COUNT sprites x 2 cells:
+    //                 +0: x (low 16 bits, signed) | y << 16 (signed)
+    //                 +1: tile index (bits 0-6) | SPR_* flags
+    //   TMAP_BASE:  TMAP_COLS x TMAP_ROWS map cells: tile index (bits 0-6) | TILE_FLIP_* flags,
+    //               a 256x256 pixel plane that wraps and is scrolled by SCROLL_X/Y
+    //   TILE_BASE:  TILE_COUNT 8x8 patterns, 16 cells each; one colour index per
+    //               byte, 4 pixels per cell, leftmost pixel in the low byte. Bit 7 of
+    //               a tile index is ignored, so tiles 128-255 show 0-127
+    static constexpr u32 GFX_CTRL_ADDR = IO_BASE + 20; // GFX_* enable bits
+    static constexpr u32 SCROLL_X_ADDR = IO_BASE + 21;
+    static constexpr u32 SCROLL_Y_ADDR = IO_BASE + 22;
+
+    // Framebuffer format. In FB_MODE_INDEXED8 the first FB_INDEXED_SIZE cells at
+    // FB_BASE hold one palette index per byte (4 pixels per cell, leftmost pixel
+    // in the low byte) and the host expands them through PAL_BASE; index 0 is an
+    // ordinary colour here, not transparent.
+    static constexpr u32 FB_MODE_ADDR = IO_BASE + 23;
+    static constexpr u32 FB_MODE_ARGB     = 0;
+    static constexpr u32 FB_MODE_INDEXED8 = 1;
+    static constexpr u32 FB_INDEXED_SIZE  = FB_SIZE / 4; // cells
+
+    static constexpr u32 GFX_TILES   = 1u << 0;
+    static constexpr u32 GFX_SPRITES = 1u << 1;
+
+    static constexpr u32 PAL_SIZE = 256;
+    static constexpr u32 PAL_BASE = AUD_BASE - PAL_SIZE;
+
+    static constexpr u32 SPR_COUNT = 64;
+    static constexpr u32 SPR_CELLS = 2;
+    static constexpr u32 SPR_SIZE  = SPR_COUNT * SPR_CELLS;
+    static constexpr u32 SPR_BASE  = PAL_BASE - SPR_SIZE;
+    static constexpr u32 SPR_FLIP_X = 1u << 8;
+    static constexpr u32 SPR_FLIP_Y = 1u << 9;
+    static constexpr u32 SPR_BEHIND = 1u << 10; // drawn under the tile layer
+    static constexpr u32 SPR_ENABLE = 1u << 11;
+
+    static constexpr u32 TMAP_COLS = 32;
+    static constexpr u32 TMAP_ROWS = 32;
+    static constexpr u32 TMAP_SIZE = TMAP_COLS * TMAP_ROWS;
+    static constexpr u32 TMAP_BASE = SPR_BASE - TMAP_SIZE;
+    static constexpr u32 TILE_FLIP_X = 1u << 8;
+    static constexpr u32 TILE_FLIP_Y = 1u << 9;
+
+    static constexpr u32 TILE_COUNT = 128;
+    static constexpr u32 TILE_CELLS = 16; // 8x8 pixels, 4 per cell
+    static constexpr u32 TILE_BASE  = TMAP_BASE - TILE_COUNT * TILE_CELLS;
+
+    // Green threads. Thread 0 is the main program on the main stack; SPAWN
+    // starts threads 1..THREAD_SLOTS-1, each on its own THREAD_STACK_CELLS
+    // slice (the spawn argument is pushed on it). Scheduling is cooperative
+    // round-robin over a ring of ready threads: YIELD moves to the next one,
+    // JOIN blocks until its target finishes. HALT in a spawned thread finishes
+    // it with the top of its stack (0 if empty) as the result; HALT in thread 0
+    // halts the VM. Thread control blocks live in memory so snapshots include
+    // the scheduler, but only the VM may write them. THREAD_ID_ADDR holds the
+    // running thread. Threads need the main stack to end at THREAD_TCB_BASE or
+    // below (the default 1024 cells do).
+    static constexpr u32 THREAD_ID_ADDR     = IO_BASE + 5;
+    static constexpr u32 THREAD_SLOTS       = 64;
+    static constexpr u32 TCB_CELLS          = 8;
+    static constexpr u32 THREAD_TCB_BASE    = STACK_BASE + 1024;
+    static constexpr u32 THREAD_STACK_CELLS = 32;
+    static constexpr u32 THREAD_STACK_BASE  = THREAD_TCB_BASE + THREAD_SLOTS * TCB_CELLS;
+    static constexpr u32 THREAD_STACK_END   = THREAD_STACK_BASE + (THREAD_SLOTS - 1) * THREAD_STACK_CELLS;
+
+    // Default heap region: the free cells between the thread stacks and the tiles
+    static constexpr u32 HEAP_BASE  = THREAD_STACK_END;
+    static constexpr u32 HEAP_CELLS = TILE_BASE - HEAP_BASE;
+
+    // Thread control block fields and states
+    static constexpr u32 TCB_IP     = 0; // saved while not running
+    static constexpr u32 TCB_SP     = 1;
+    static constexpr u32 TCB_STATE  = 2;
+    static constexpr u32 TCB_JOINER = 3; // joining thread id + 1, 0 = none
+    static constexpr u32 TCB_NEXT   = 4; // ready ring links
+    static constexpr u32 TCB_PREV   = 5;
+    static constexpr u32 TCB_RESULT = 6; // once THREAD_DONE
+
+    static constexpr u32 THREAD_FREE    = 0;
+    static constexpr u32 THREAD_READY   = 1; // in the ready ring (includes the running thread)
+    static constexpr u32 THREAD_BLOCKED = 2; // in JOIN
+    static constexpr u32 THREAD_DONE    = 3; // finished, result not yet joined
+
+    // Multi-core. Core k runs on its own host thread with the CORE_STACK_CELLS
+    // stack slice at STACK_BASE + k * CORE_STACK_CELLS, so core 0 needs a stack
+    // capacity of CORE_STACK_CELLS or less. Loads from CORE_ID_ADDR read the
+    // running core's id; CORE_COUNT_ADDR holds the number of cores (1 outside a
+    // multi-core run). A store to BARRIER_ADDR waits until every running core
+    // has stored to it; cores that finish leave the barrier. Plain loads and
+    // stores are not ordered between cores: share data with LOAD_ACQ/STORE_REL,
+    // CAS and XADD or across the barrier. Interrupts, green threads and the heap
+    // stay on core 0.
+    static constexpr u32 CORE_ID_ADDR     = IO_BASE + 24;
+    static constexpr u32 BARRIER_ADDR     = IO_BASE + 25;
+    static constexpr u32 CORE_COUNT_ADDR  = IO_BASE + 26;
+    static constexpr u32 MAX_CORES        = 8;
+    static constexpr u32 CORE_STACK_CELLS = 128;
+
+    // DMA channel. Storing DMA_START to DMA_CTRL_ADDR copies DMA_LEN_ADDR cells
+    // from DMA_SRC_ADDR to DMA_DST_ADDR on a host worker thread while the
+    // program keeps running; with DMA_FROM_BLOB the source is a cell offset into
+    // host blob ctrl >> DMA_BLOB_SHIFT (see setDmaBlob()). DMA_STATUS_ADDR reads
+    // DMA_BUSY until the copy has landed, then DMA_DONE, and IRQ_DMA is raised;
+    // a source or destination out of range, or a destination in the I/O page,
+    // ends with DMA_ERROR straight away. The worker publishes the status with a
+    // release store, so poll it with LOAD_ACQ (or take the interrupt) before
+    // touching the destination. Storing DMA_WAIT blocks until the transfer in
+    // flight completes; DMA_START, snapshots and reset() wait the same way. The
+    // interrupt still arrives whenever the host copy finishes, so recorded runs
+    // use setDmaSynchronous().
+    // Only core 0 drives the channel.
+    static constexpr u32 DMA_SRC_ADDR    = IO_BASE + 28;
+    static constexpr u32 DMA_DST_ADDR    = IO_BASE + 29;
+    static constexpr u32 DMA_LEN_ADDR    = IO_BASE + 30; // cells
+    static constexpr u32 DMA_CTRL_ADDR   = IO_BASE + 31;
+    static constexpr u32 DMA_STATUS_ADDR = IO_BASE + 32;
+    static constexpr u32 MAX_DMA_BLOBS   = 256;
+
+    static constexpr u32 DMA_START      = 1u << 0;
+    static constexpr u32 DMA_FROM_BLOB  = 1u << 1;
+    static constexpr u32 DMA_WAIT       = 1u << 2;
+    static constexpr u32 DMA_BLOB_SHIFT = 8;
+
+    static constexpr u32 DMA_IDLE  = 0;
+    static constexpr u32 DMA_BUSY  = 1;
+    static constexpr u32 DMA_DONE  = 2;
+    static constexpr u32 DMA_ERROR = 3;
+
+    static constexpr std::size_t OUT_BUFFER_SIZE = 64 * 1024; // bytes buffered before a write
+    static constexpr std::size_t NATIVE_SLICE = 1u << 14;      // instructions per call into native code or register IR
+
+    static_assert(Snapshot::PAGE_CELLS * Snapshot::PAGE_COUNT == MEM_SIZE, "snapshot pages must cover memory");
+    static_assert(STACK_BASE + MAX_CORES * CORE_STACK_CELLS <= THREAD_TCB_BASE, "core stacks must fit the main stack");
+    static_assert(HEAP_CELLS >= Heap::MIN_CELLS, "default heap must fit below the tiles");
+
 private:
+    VM(std::shared_ptr<std::vector<i32>> storage, u32 coreId); // secondary core, see makeCores()
+
+    Result exec(); // one instruction; step() adds fault reporting
+    Result runTranslated(std::size_t maxSteps); // run() with native code or register IR
+    bool chargeGas(Result& r); // entering a run at m_ip; false when stopping
+    void enterRun() { m_gasPending = m_gasOn; } // control transfer: charge before the next instruction
     bool fetchCell(u32& out);
+    u32 stackLimit() const; // exclusive end of the main thread's stack
+    i32 loadCell(u32 addr) const { return addr == CORE_ID_ADDR ? static_cast<i32>(m_coreId) : m_mem[addr]; }
+    void storeCell(u32 addr, i32 v) {
+        if (addr == BARRIER_ADDR) { arriveAtBarrier(); return; }
+        m_mem[addr] = v;
+        markDirty(addr);
+        if (addr == DMA_CTRL_ADDR) controlDma(static_cast<u32>(v));
+    }
+    void arriveAtBarrier();
+    void controlDma(u32 ctrl); // store to DMA_CTRL_ADDR
+    void waitDma();
+    static std::uint64_t pageMask(u32 base, u32 cells); // snapshot pages overlapping a region
+    std::uint64_t stackDirtyMask() const; // snapshot pages written without markDirty()
+
+    // Green threads (see THREAD_SLOTS)
+    i32& tcb(u32 id, u32 field) { return m_mem[THREAD_TCB_BASE + id * TCB_CELLS + field]; }
+    u32 link(u32 id, u32 field) { return static_cast<u32>(tcb(id, field)) & (THREAD_SLOTS - 1); }
+    void setStackBounds(u32 id);
+    void initThreads();
+    void linkBefore(u32 id, u32 at); // insert id into the ready ring before `at`
+    void unlink(u32 id);             // remove id from the ready ring
+    bool switchTo(u32 id, bool saveCurrent, Result& r);
+    bool finishThread(Result& r);
     bool push(i32 v);
     bool pop(i32& out);
     bool peek2(i32& a, i32& b); // a=top, b=second from top
+    bool serviceIrq(Result& r); // deliver a pending interrupt; false on fault
+    void markDirty(u32 addr) { m_dirtyPages |= std::uint64_t{1} << (addr / Snapshot::PAGE_CELLS); }
 
-    std::vector<i32> m_mem; // unified memory (cells of i32)
+    std::shared_ptr<std::vector<i32>> m_storage; // shared by the cores of a multi-core run
+    std::vector<i32>& m_mem; // unified memory (cells of i32)
     u32 m_ip{0};
+    u32 m_insnIp{0}; // address of the instruction being executed
     u32 m_sp{0}; // stack pointer: index of next free slot (top is sp-1)
     std::size_t m_stackCap{0}; // logical stack capacity (for compatibility)
+    u32 m_stackBase{STACK_BASE}; // main thread's stack, per core
+    u32 m_stackLo{STACK_BASE}; // running thread's stack bounds
+    u32 m_stackHi{STACK_BASE};
+    u32 m_thread{0};           // running thread id
+    u32 m_coreId{0};
+    std::shared_ptr<CoreBarrier> m_barrier; // while cores exist
+
+    std::atomic<u32> m_irqPending{0}; // bit per line, set by raiseIrq()
+    bool m_inIrq{false};              // handler running; delivery held until RETI
+    bool m_waiting{false};            // parked by HALT_UNTIL_IRQ
+    bool m_halted{false};
+
+    std::vector<Syscall> m_syscalls;
+
+    std::vector<TraceEntry> m_trace; // ring, empty when tracing is off
+    std::uint64_t m_traceCount{0};   // instructions traced so far
+    std::FILE* m_traceFile{stderr};
+
+    void sampleProfile();
+    u32 m_profileInterval{0};  // 0 = profiler off
+    u32 m_profileCountdown{0}; // instructions until the next sample
+    std::unordered_map<std::uint64_t, std::uint64_t> m_profile; // (irqFrom+1) << 32 | ip -> count
+    u32 m_irqFrom{0};          // ip interrupted by the running handler
+
+    GasSchedule m_gasSchedule;
+    std::vector<u32> m_gasTable; // per code cell, see buildGasTable()
+    u32 m_codeSize{0};           // cells passed to load()
+    std::uint64_t m_gas{0};
+    std::shared_ptr<std::atomic<std::uint64_t>> m_sharedGas; // the budget while cores exist, else null
+    bool m_gasOn{false};
+    bool m_gasPending{false};    // the current run has not been paid for yet
+
+    // Snapshot tracking. The stack is written without marking, so its pages are
+    // always treated as dirty. m_basePages are the pages of the last snapshot or
+    // restore; clean pages are known to match them.
+    std::array<std::shared_ptr<const Snapshot::Page>, Snapshot::PAGE_COUNT> m_basePages;
+    std::uint64_t m_dirtyPages{~std::uint64_t{0}};
+
+    Heap m_heap{HEAP_BASE, HEAP_CELLS};
+    std::uint64_t m_heapPages{0}; // snapshot pages of the heap region, dirtied by heap ops
+
+    const LjAotProgram* m_native{nullptr};
+    std::vector<bool> m_nativeEntry; // per code cell: run() may enter native code here
+    bool m_regIrOn{false};
+    std::shared_ptr<const RegisterProgram> m_regIr; // for the loaded program
+
+    std::string m_out;          // pending console output
+    std::FILE* m_outFile{stdout};
+
+    std::vector<std::shared_ptr<const std::vector<i32>>> m_dmaBlobs; // by id, up to the highest set
+    bool m_dmaSync{false};
+    std::unique_ptr<DmaChannel> m_dma; // created by the first transfer; last, so it stops first
 };
 
 } // namespace vm32